@@ -0,0 +1,182 @@
+// Benchmark harness for PriceTracker-CLI.c.
+//
+// Generates a synthetic ledger and times the core operations on it, printing
+// one Google-Benchmark style row per operation:
+//   PriceTracker-CLI-bench [--users N] [--expenses N] [--fanout N] [--settlements N] [--seed N]
+// --fanout is the number of debtors per expense (at most 49); --settlements
+// is how many settlements are queued and processed after the expenses.
+//
+// The tracker's own output (processing and report printing) goes to
+// /dev/null; the results table is written to the original stdout.
+#define PRICETRACKER_NO_MAIN
+#include "PriceTracker-CLI.c"
+
+#include <unistd.h>
+
+struct BenchConfig {
+    long users;
+    long expenses;
+    long fanout;
+    long settlements;
+    unsigned long long seed;
+};
+
+FILE *benchOut;
+
+// Small deterministic generator so runs are comparable
+unsigned long long benchState;
+
+long benchBelow(long n) {
+    benchState = benchState * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (long)((benchState >> 33) % (unsigned long long)n);
+}
+
+double wallSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+double cpuSeconds() {
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+// Timing brackets around one benchmark body
+double benchWallStart, benchCpuStart;
+
+void startBenchmark() {
+    fflush(stdout);
+    benchWallStart = wallSeconds();
+    benchCpuStart = cpuSeconds();
+}
+
+void stopBenchmark(const char *name, long iterations) {
+    fflush(stdout);
+    double wall = wallSeconds() - benchWallStart;
+    double cpu = cpuSeconds() - benchCpuStart;
+    long n = iterations > 0 ? iterations : 1;
+    fprintf(benchOut, "%-40s %12.0f ns %12.0f ns %12ld %15.0f\n", name,
+            wall * 1e9 / n, cpu * 1e9 / n, iterations, wall > 0 ? iterations / wall : 0.0);
+}
+
+int parseArgs(int argc, char *argv[], struct BenchConfig *config) {
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            return 0;
+        }
+        long value = strtol(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--users") == 0) {
+            config->users = value;
+        } else if (strcmp(argv[i], "--expenses") == 0) {
+            config->expenses = value;
+        } else if (strcmp(argv[i], "--fanout") == 0) {
+            config->fanout = value;
+        } else if (strcmp(argv[i], "--settlements") == 0) {
+            config->settlements = value;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            config->seed = (unsigned long long)value;
+        } else {
+            return 0;
+        }
+    }
+    return config->fanout >= 0 && config->fanout < 50 && config->users > config->fanout;
+}
+
+int main(int argc, char *argv[]) {
+    struct BenchConfig config = {10000, 200000, 4, 20000, 42};
+    if (!parseArgs(argc, argv, &config)) {
+        fprintf(stderr, "Usage: %s [--users N] [--expenses N] [--fanout N] [--settlements N] [--seed N]\n"
+                        "(--fanout at most 49, and --users must exceed it)\n", argv[0]);
+        return 1;
+    }
+
+    // Keep the results on the real stdout and silence the tracker
+    benchOut = fdopen(dup(STDOUT_FILENO), "w");
+    if (benchOut == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        perror("redirect stdout");
+        return 1;
+    }
+
+    // Generate the workload up front so only ledger work is timed
+    benchState = config.seed;
+    char (*names)[50] = malloc(config.users * sizeof(*names));
+    for (long i = 0; i < config.users; i++) {
+        sprintf(names[i], "user%ld", i);
+    }
+
+    long *payers = malloc(config.expenses * sizeof(long));
+    Money *amounts = malloc(config.expenses * sizeof(Money));
+    long *debtors = malloc(config.expenses * (config.fanout + 1) * sizeof(long));
+    for (long e = 0; e < config.expenses; e++) {
+        long *row = debtors + e * (config.fanout + 1);
+        payers[e] = benchBelow(config.users);
+        amounts[e] = 100 + benchBelow(100000);
+        for (long d = 0; d < config.fanout; ) {
+            long debtor = benchBelow(config.users);
+            int duplicate = debtor == payers[e];
+            for (long k = 0; k < d && !duplicate; k++) {
+                duplicate = row[k] == debtor;
+            }
+            if (!duplicate) {
+                row[d++] = debtor;
+            }
+        }
+    }
+
+    fprintf(benchOut, "PriceTracker-CLI.c: users=%ld expenses=%ld fanout=%ld settlements=%ld seed=%llu\n\n",
+            config.users, config.expenses, config.fanout, config.settlements, config.seed);
+    fprintf(benchOut, "%-40s %15s %15s %12s %15s\n", "Benchmark", "Time", "CPU", "Iterations", "Items/s");
+    for (int i = 0; i < 101; i++) {
+        fputc('-', benchOut);
+    }
+    fputc('\n', benchOut);
+
+    char splitAmong[50][50];
+    char description[] = "bench expense";
+    startBenchmark();
+    for (long e = 0; e < config.expenses; e++) {
+        long *row = debtors + e * (config.fanout + 1);
+        for (long d = 0; d < config.fanout; d++) {
+            strcpy(splitAmong[d], names[row[d]]);
+        }
+        addExpense(description, amounts[e], names[payers[e]], splitAmong, (int)config.fanout);
+    }
+    stopBenchmark("BM_AddExpense", config.expenses);
+
+    for (long i = 0; i < config.settlements; i++) {
+        long from = benchBelow(config.users), to;
+        do {
+            to = benchBelow(config.users);
+        } while (to == from);
+        enqueueSettlement(names[from], names[to], 100 + benchBelow(5000));
+    }
+    startBenchmark();
+    for (long i = 0; i < config.settlements; i++) {
+        dequeueSettlement();
+    }
+    stopBenchmark("BM_ProcessSettlement", config.settlements);
+
+    startBenchmark();
+    printBalances();
+    stopBenchmark("BM_PrintBalances", config.users);
+
+    startBenchmark();
+    printGraph();
+    stopBenchmark("BM_PrintGraph", graphEdgeIndex.count);
+
+    startBenchmark();
+    printExpenses();
+    stopBenchmark("BM_PrintExpenses", expenseStore.count);
+
+    long expenseCount = expenseStore.count;
+    startBenchmark();
+    freeLedger();
+    stopBenchmark("BM_FreeLedger", expenseCount);
+
+    free(names);
+    free(payers);
+    free(amounts);
+    free(debtors);
+    fclose(benchOut);
+    return 0;
+}
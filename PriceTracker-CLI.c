@@ -1,33 +1,59 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+// Amounts are kept in minor units (cents) so splits and balances stay exact
+typedef long long Money;
 
 // Define structures
 
-// Linked list node for storing expenses
-struct Expense {
-    char description[100];
-    float amount;
-    char paidBy[50];
-    char splitAmong[50][50]; // Users who share the expense
-    float amountOwed[50];     // Amount owed by each user
-    int userCount;            // Number of users sharing the expense
-    struct Expense *next;
+// Columnar store for expenses. Per-expense columns are indexed by expense
+// row; the split lists of all expenses sit back to back in one participant
+// arena, and expense i owns slots [participantOffsets[i], participantOffsets[i + 1]).
+// Slot 0 of every expense is the payer, and users are referenced by their
+// balance node. Columns grow geometrically, so there is no malloc per expense.
+struct ExpenseStore {
+    int count, capacity;
+    Money *amounts;
+    struct UserBalance **payers;
+    long *participantOffsets;          // count + 1 entries
+    long *descriptionOffsets;          // Start of each description
+    struct UserBalance **participants; // Participant arena
+    Money *owed;                       // Amount owed, parallel to participants
+    long participantCount, participantCapacity;
+    char *descriptions;                // NUL-terminated descriptions, back to back
+    long descriptionBytes, descriptionCapacity;
 };
 
 // Queue node for settlement transactions
 struct Settlement {
     char fromUser[50];
     char toUser[50];
-    float amount;
+    Money amount;
     struct Settlement *next;
 };
 
-// Binary search tree node for user balances
+// Record for one user's balance
 struct UserBalance {
     char userName[50];
-    float balance; // Positive if others owe, negative if they owe
-    struct UserBalance *left, *right;
+    Money balance; // Positive if others owe, negative if they owe
+    long *slots; // Participant slots this user appears in
+    int slotCount, slotCapacity;
+};
+
+// B-tree node indexing user balances by name. Every node except the root
+// holds between BALANCE_MIN_DEGREE - 1 and BALANCE_MAX_USERS users, so the
+// tree stays balanced whatever order names arrive in, and each node's keys
+// sit together in memory.
+#define BALANCE_MIN_DEGREE 16
+#define BALANCE_MAX_USERS (2 * BALANCE_MIN_DEGREE - 1)
+
+struct BalanceNode {
+    int count;
+    int leaf;
+    struct UserBalance *users[BALANCE_MAX_USERS];
+    struct BalanceNode *children[BALANCE_MAX_USERS + 1];
 };
 
 // Graph structure to represent users and debts
@@ -39,30 +65,126 @@ struct GraphNode {
 
 struct GraphEdge {
     char toUser[50];
-    float amount;
+    Money amount;
     struct GraphEdge *next;
 };
 
+// Open-addressing hash index over graph nodes (by user) and edges (by user pair)
+struct GraphSlot {
+    unsigned long long hash;
+    struct GraphNode *node;
+    struct GraphEdge *edge;
+};
+
+struct GraphIndex {
+    struct GraphSlot *slots;
+    size_t capacity, count;
+};
+
+// Open-addressing hash index over users by name. Lookups on the expense and
+// settlement paths go through it; the B-tree keeps the users in name order
+// for the reports.
+struct UserSlot {
+    unsigned long long hash;
+    struct UserBalance *user;
+};
+
+struct UserIndex {
+    struct UserSlot *slots;
+    size_t capacity, count;
+};
+
+// Slab allocator for one fixed-size node type. Nodes are carved from large
+// slabs in allocation order, so nodes created together sit together in
+// memory; freed nodes go on an intrusive free list that is reused first.
+// Nothing goes back to malloc until the whole pool is released.
+#define POOL_SLAB_BYTES (64 * 1024)
+
+struct PoolSlab {
+    struct PoolSlab *next;
+    long align; // Keeps the nodes that follow the header 8-byte aligned
+};
+
+struct NodePool {
+    long nodeSize;
+    long nodesPerSlab;
+    struct PoolSlab *slabs; // Every slab, newest first
+    char *unused, *end;     // Never-allocated tail of the newest slab
+    void *freeList;         // Freed nodes, linked through their first word
+    long live;              // Nodes currently handed out
+};
+
+#define NODE_POOL(type) {sizeof(type), (POOL_SLAB_BYTES - sizeof(struct PoolSlab)) / sizeof(type), NULL, NULL, NULL, NULL, 0}
+
+// Output formats for the expense, balance and graph reports
+enum ReportFormat { REPORT_TABLE, REPORT_CSV, REPORT_JSON };
+
+// Reports are built in one reusable buffer and handed to stdio in large
+// chunks instead of one printf per line
+#define REPORT_CAPACITY (1 << 20)
+
+struct ReportBuffer {
+    char *data;
+    long used;
+};
+
 // Global variables
-struct Expense *expenseHead = NULL; // Linked list head for expenses
+struct ExpenseStore expenseStore = {0}; // Columnar store for expenses
 struct Settlement *settlementFront = NULL, *settlementRear = NULL; // Queue for settlements
-struct UserBalance *balanceRoot = NULL; // Root of BST for user balances
+struct BalanceNode *balanceRoot = NULL; // Root of the B-tree of user balances
 struct GraphNode *graphHead = NULL; // Head of the graph for user debts
+struct GraphIndex graphNodeIndex = {NULL, 0, 0}; // fromUser -> graph node
+struct GraphIndex graphEdgeIndex = {NULL, 0, 0}; // (fromUser, toUser) -> graph edge
+struct UserIndex userIndex = {NULL, 0, 0}; // userName -> balance record
+enum ReportFormat reportFormat = REPORT_TABLE; // Format of the reports
+struct ReportBuffer report = {NULL, 0}; // Output buffer shared by the reports
+
+// One pool per node type
+struct NodePool settlementPool = NODE_POOL(struct Settlement);
+struct NodePool userPool = NODE_POOL(struct UserBalance);
+struct NodePool balanceNodePool = NODE_POOL(struct BalanceNode);
+struct NodePool graphNodePool = NODE_POOL(struct GraphNode);
+struct NodePool graphEdgePool = NODE_POOL(struct GraphEdge);
 
 // Function declarations
-void addExpense(char *description, float amount, char *paidBy, char splitAmong[50][50], int userCount);
+void addExpense(char *description, Money amount, char *paidBy, char splitAmong[50][50], int userCount);
 void printExpenses();
-struct UserBalance* addUserBalance(struct UserBalance *root, char *userName, float balanceUpdate);
-struct UserBalance* searchUser(struct UserBalance *root, char *userName);
-void printBalances(struct UserBalance *root);
-void enqueueSettlement(char *fromUser, char *toUser, float amount);
+struct UserBalance* addUserBalance(char *userName, Money balanceUpdate);
+struct UserBalance* searchUser(char *userName);
+struct UserSlot* findUserSlot(unsigned long long hash, char *userName);
+void reserveUserIndex();
+unsigned long long hashString(unsigned long long hash, const char *str);
+void printBalances();
+struct UserBalance* findOrAddUser(char *userName);
+void indexExpenseSlot(struct UserBalance *user, long slot);
+void enqueueSettlement(char *fromUser, char *toUser, Money amount);
 void dequeueSettlement();
+void applySettlement(char *fromUser, char *toUser, Money amount);
 void printSettlements();
+int ingestFile(const char *path);
+int parseReportFormat(const char *name, enum ReportFormat *format);
+void freeLedger();
+
+// Node pools
+void *poolAlloc(struct NodePool *pool);
+void poolFree(struct NodePool *pool, void *node);
+void poolRelease(struct NodePool *pool);
+
+// Report output
+void reportBegin();
+void reportFlush();
+char *reportReserve(long size);
+void reportText(const char *text);
+void reportMoney(Money amount);
+void reportCsv(const char *text);
+void reportJson(const char *text);
 
 // Graph functions
-void addDebtToGraph(char *fromUser, char *toUser, float amount);
+void addDebtToGraph(char *fromUser, char *toUser, Money amount);
+struct GraphSlot* findGraphSlot(struct GraphIndex *index, unsigned long long hash, char *fromUser, char *toUser);
+void reserveGraphIndex(struct GraphIndex *index);
 void printGraph();
-void updateExpenseAfterSettlement(char *fromUser, char *toUser, float amount);
+void updateExpenseAfterSettlement(char *fromUser, char *toUser, Money amount);
 
 // Function to read a string input (removes newline character)
 void readString(char *str, int size) {
@@ -70,9 +192,97 @@ void readString(char *str, int size) {
     str[strcspn(str, "\n")] = '\0'; // Remove the trailing newline
 }
 
-// Main function
-int main() {
+// Function to parse a decimal amount such as "-12.5" into cents,
+// rounding half away from zero past the second decimal place
+int parseMoney(const char *text, Money *amount) {
+    int negative = *text == '-';
+    int wholeDigits = 0, fractionDigits = 0, roundUp = 0;
+    Money cents = 0;
+
+    if (negative) {
+        text++;
+    }
+    for (; *text >= '0' && *text <= '9'; text++, wholeDigits++) {
+        if (wholeDigits == 16) {
+            return 0; // Would overflow once scaled to cents
+        }
+        cents = cents * 10 + (*text - '0');
+    }
+    cents *= 100;
+    if (*text == '.') {
+        for (text++; *text >= '0' && *text <= '9'; text++, fractionDigits++) {
+            if (fractionDigits == 0) {
+                cents += (*text - '0') * 10;
+            } else if (fractionDigits == 1) {
+                cents += *text - '0';
+            } else if (fractionDigits == 2) {
+                roundUp = *text >= '5';
+            }
+        }
+    }
+    if (wholeDigits + fractionDigits == 0 || *text != '\0') {
+        return 0;
+    }
+
+    cents += roundUp;
+    *amount = negative ? -cents : cents;
+    return 1;
+}
+
+// Function to format cents as a decimal amount (buffer needs 24 bytes)
+char *formatMoney(Money amount, char *buffer) {
+    unsigned long long magnitude = amount < 0 ? 0ULL - (unsigned long long)amount : (unsigned long long)amount;
+    sprintf(buffer, "%s%llu.%02llu", amount < 0 ? "-" : "", magnitude / 100, magnitude % 100);
+    return buffer;
+}
+
+// Function to read an amount, asking again until it parses
+Money readMoney() {
+    char line[64];
+    Money amount;
+    readString(line, 64);
+    while (!parseMoney(line, &amount)) {
+        printf("Invalid amount. Enter again: ");
+        readString(line, 64);
+    }
+    return amount;
+}
+
+// Function to parse a report format name
+int parseReportFormat(const char *name, enum ReportFormat *format) {
+    if (strcmp(name, "table") == 0) {
+        *format = REPORT_TABLE;
+    } else if (strcmp(name, "csv") == 0) {
+        *format = REPORT_CSV;
+    } else if (strcmp(name, "json") == 0) {
+        *format = REPORT_JSON;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Main function (PRICETRACKER_NO_MAIN lets the benchmark harness include this file)
+#ifndef PRICETRACKER_NO_MAIN
+int main(int argc, char *argv[]) {
     int choice;
+    const char *ingestPath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ingest") == 0 && i + 1 < argc) {
+            ingestPath = argv[++i];
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc && parseReportFormat(argv[i + 1], &reportFormat)) {
+            i++;
+        } else {
+            fprintf(stderr, "Usage: %s [--ingest <file>] [--format table|csv|json]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (ingestPath != NULL) {
+        int ok = ingestFile(ingestPath);
+        freeLedger();
+        return ok ? 0 : 1;
+    }
 
     while (1) {
         printf("\n--- Expense Splitter ---\n");
@@ -90,7 +300,7 @@ int main() {
         if (choice == 1) {
             // Add Expense
             char description[100];
-            float amount;
+            Money amount;
             char paidBy[50];
             int userCount;
 
@@ -98,8 +308,7 @@ int main() {
             readString(description, 100);
 
             printf("Enter total amount: ");
-            scanf("%f", &amount);
-            getchar(); // Consume newline character
+            amount = readMoney();
 
             printf("Enter who paid (user): ");
             readString(paidBy, 50);
@@ -125,7 +334,7 @@ int main() {
         else if (choice == 3) {
             // Add Settlement
             char fromUser[50], toUser[50];
-            float amount;
+            Money amount;
 
             printf("\nEnter the user who will pay: ");
             readString(fromUser, 50);
@@ -134,8 +343,7 @@ int main() {
             readString(toUser, 50);
 
             printf("Enter the amount to settle: ");
-            scanf("%f", &amount);
-            getchar(); // Consume newline character
+            amount = readMoney();
 
             enqueueSettlement(fromUser, toUser, amount);
         }
@@ -145,8 +353,10 @@ int main() {
 
         else if (choice == 4) {
             // View User Balances
-            printf("\nUser Balances:\n");
-            printBalances(balanceRoot);
+            if (reportFormat == REPORT_TABLE) {
+                printf("\nUser Balances:\n");
+            }
+            printBalances();
         }
         else if (choice == 5) {
             // Process Settlement
@@ -155,11 +365,14 @@ int main() {
         }
         else if (choice == 6) {
             // View Debt Graph
-            printf("\nDebt Graph:\n");
+            if (reportFormat == REPORT_TABLE) {
+                printf("\nDebt Graph:\n");
+            }
             printGraph();
         }
         else if (choice == 7) {
             // Exit
+            freeLedger();
             break;
         }
         else {
@@ -169,173 +382,715 @@ int main() {
 
     return 0;
 }
+#endif
+
+// Function to double a capacity until it holds at least needed elements
+long grownCapacity(long capacity, long needed) {
+    if (capacity == 0) {
+        capacity = 64;
+    }
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+// Function to take a node from a pool: a freed node if there is one,
+// otherwise the next unused node of the newest slab
+void *poolAlloc(struct NodePool *pool) {
+    void *node = pool->freeList;
+    if (node != NULL) {
+        pool->freeList = *(void **)node;
+    } else {
+        if (pool->unused == pool->end) {
+            struct PoolSlab *slab = (struct PoolSlab *)malloc(sizeof(struct PoolSlab) + pool->nodesPerSlab * pool->nodeSize);
+            slab->next = pool->slabs;
+            pool->slabs = slab;
+            pool->unused = (char *)(slab + 1);
+            pool->end = pool->unused + pool->nodesPerSlab * pool->nodeSize;
+        }
+        node = pool->unused;
+        pool->unused += pool->nodeSize;
+    }
+    pool->live++;
+    return node;
+}
+
+// Function to return a node to its pool's free list
+void poolFree(struct NodePool *pool, void *node) {
+    *(void **)node = pool->freeList;
+    pool->freeList = node;
+    pool->live--;
+}
+
+// Function to free every slab of a pool, invalidating all of its nodes
+void poolRelease(struct NodePool *pool) {
+    while (pool->slabs != NULL) {
+        struct PoolSlab *next = pool->slabs->next;
+        free(pool->slabs);
+        pool->slabs = next;
+    }
+    pool->unused = pool->end = NULL;
+    pool->freeList = NULL;
+    pool->live = 0;
+}
+
+// Function to free the users' slot lists under a B-tree node
+void freeUserSlots(struct BalanceNode *node) {
+    for (int i = 0; i < node->count; i++) {
+        free(node->users[i]->slots);
+    }
+    if (!node->leaf) {
+        for (int i = 0; i <= node->count; i++) {
+            freeUserSlots(node->children[i]);
+        }
+    }
+}
+
+// Function to release everything the ledger holds and reset it to empty
+void freeLedger() {
+    if (balanceRoot != NULL) {
+        freeUserSlots(balanceRoot);
+    }
+    poolRelease(&settlementPool);
+    poolRelease(&userPool);
+    poolRelease(&balanceNodePool);
+    poolRelease(&graphNodePool);
+    poolRelease(&graphEdgePool);
+    settlementFront = settlementRear = NULL;
+    balanceRoot = NULL;
+    graphHead = NULL;
+
+    free(graphNodeIndex.slots);
+    free(graphEdgeIndex.slots);
+    graphNodeIndex = graphEdgeIndex = (struct GraphIndex){NULL, 0, 0};
+    free(userIndex.slots);
+    userIndex = (struct UserIndex){NULL, 0, 0};
+
+    free(expenseStore.amounts);
+    free(expenseStore.payers);
+    free(expenseStore.participantOffsets);
+    free(expenseStore.descriptionOffsets);
+    free(expenseStore.participants);
+    free(expenseStore.owed);
+    free(expenseStore.descriptions);
+    memset(&expenseStore, 0, sizeof(expenseStore));
+
+    free(report.data);
+    report.data = NULL;
+    report.used = 0;
+}
 
-// Function to add a new expense to the linked list
-void addExpense(char *description, float amount, char *paidBy, char splitAmong[50][50], int userCount) {
-    struct Expense *newExpense = (struct Expense *)malloc(sizeof(struct Expense));
+// Function to make room for one more expense with the given participant and description sizes
+void reserveExpense(struct ExpenseStore *store, int participants, long descriptionSize) {
+    if (store->count == store->capacity) {
+        store->capacity = (int)grownCapacity(store->capacity, store->count + 1);
+        store->amounts = (Money *)realloc(store->amounts, store->capacity * sizeof(Money));
+        store->payers = (struct UserBalance **)realloc(store->payers, store->capacity * sizeof(struct UserBalance *));
+        store->descriptionOffsets = (long *)realloc(store->descriptionOffsets, store->capacity * sizeof(long));
+        store->participantOffsets = (long *)realloc(store->participantOffsets, (store->capacity + 1) * sizeof(long));
+        store->participantOffsets[0] = store->count == 0 ? 0 : store->participantOffsets[0];
+    }
+
+    if (store->participantCount + participants > store->participantCapacity) {
+        store->participantCapacity = grownCapacity(store->participantCapacity, store->participantCount + participants);
+        store->participants = (struct UserBalance **)realloc(store->participants,
+                                                             store->participantCapacity * sizeof(struct UserBalance *));
+        store->owed = (Money *)realloc(store->owed, store->participantCapacity * sizeof(Money));
+    }
+
+    if (store->descriptionBytes + descriptionSize > store->descriptionCapacity) {
+        store->descriptionCapacity = grownCapacity(store->descriptionCapacity, store->descriptionBytes + descriptionSize);
+        store->descriptions = (char *)realloc(store->descriptions, store->descriptionCapacity);
+    }
+}
+
+// Function to add a new expense to the columnar store
+void addExpense(char *description, Money amount, char *paidBy, char splitAmong[50][50], int userCount) {
+    struct ExpenseStore *store = &expenseStore;
+    long descriptionSize = (long)strlen(description) + 1;
+    reserveExpense(store, userCount + 1, descriptionSize);
+
+    int row = store->count;
+    long first = store->participantOffsets[row];
+    struct UserBalance *payer = findOrAddUser(paidBy);
 
     // Set the description, total amount, and who paid
-    strcpy(newExpense->description, description);
-    newExpense->amount = amount;
-    strcpy(newExpense->paidBy, paidBy);
+    store->descriptionOffsets[row] = store->descriptionBytes;
+    memcpy(store->descriptions + store->descriptionBytes, description, descriptionSize);
+    store->descriptionBytes += descriptionSize;
+    store->amounts[row] = amount;
+    store->payers[row] = payer;
 
-    // Calculate the amount each user owes
-    float amountPerUser = amount / (userCount + 1);  // Include the payer in the split
+    // Calculate the amount each user owes, including the payer in the split.
+    // The leftover cents go one each to the first users, so the shares add
+    // up to exactly the amount.
+    Money amountPerUser = amount / (userCount + 1);
+    Money remainder = amount % (userCount + 1);
+    Money payerCredit = 0;
 
     // Set the payer's owed amount to 0 (since they paid)
-    newExpense->amountOwed[0] = 0.0;
-    strcpy(newExpense->splitAmong[0], paidBy);  // The first user is the one who paid
+    store->participants[first] = payer;  // The first user is the one who paid
+    store->owed[first] = 0;
 
-    // Set the amount owed by each user (including the payer)
+    // Set the amount owed by each of the others
     for (int i = 0; i < userCount; i++) {
-        strcpy(newExpense->splitAmong[i + 1], splitAmong[i]);
-        newExpense->amountOwed[i + 1] = amountPerUser; // Each of the others owes the calculated amount
+        int slot = i + 1;
+        Money share = amountPerUser;
+        if (slot < remainder) {
+            share++;
+        } else if (slot < -remainder) {
+            share--;
+        }
+        store->participants[first + slot] = findOrAddUser(splitAmong[i]);
+        store->owed[first + slot] = share;
+        payerCredit += share;
     }
 
-    // Set the number of users sharing the expense (including the payer)
-    newExpense->userCount = userCount + 1;
-
-    // Set the 'next' pointer to the current head of the list
-    newExpense->next = expenseHead;
-
-    // Update the head of the linked list to the new expense
-    expenseHead = newExpense;
+    // Close the row
+    store->participantCount = first + userCount + 1;
+    store->participantOffsets[row + 1] = store->participantCount;
+    store->count++;
 
     // Update balances for the person who paid
-    balanceRoot = addUserBalance(balanceRoot, paidBy, amount);  // Payer gains the amount they paid
+    payer->balance += payerCredit;  // Payer is owed what the others owe
 
     // Update balances for users splitting the expense
     for (int i = 0; i < userCount; i++) {
-        balanceRoot = addUserBalance(balanceRoot, splitAmong[i], -amountPerUser);  // Each person owes
-        addDebtToGraph(paidBy, splitAmong[i], amountPerUser);  // Add debt to the graph
+        store->participants[first + i + 1]->balance -= store->owed[first + i + 1];  // Each person owes
+        addDebtToGraph(paidBy, splitAmong[i], store->owed[first + i + 1]);  // Add debt to the graph
     }
+
+    // Record where each user appears so settlements can find their rows
+    for (long slot = first; slot < store->participantCount; slot++) {
+        indexExpenseSlot(store->participants[slot], slot);
+    }
+}
+
+// Function to find a user's balance node, creating it with a zero balance if needed
+struct UserBalance* findOrAddUser(char *userName) {
+    return addUserBalance(userName, 0);
+}
+
+// Function to record that a user appears in a participant slot
+void indexExpenseSlot(struct UserBalance *user, long slot) {
+    if (user->slotCount == user->slotCapacity) {
+        user->slotCapacity = user->slotCapacity ? user->slotCapacity * 2 : 8;
+        user->slots = (long *)realloc(user->slots, user->slotCapacity * sizeof(long));
+    }
+    user->slots[user->slotCount++] = slot;
 }
 
 
 // Function to update expenses after a settlement
-void updateExpenseAfterSettlement(char *fromUser, char *toUser, float amount) {
-    struct Expense *temp = expenseHead;
-    while (temp != NULL) {
-        for (int i = 0; i < temp->userCount; i++) {
-            if (strcmp(temp->splitAmong[i], fromUser) == 0) {
-                // Decrease the owed amount for the person paying
-                temp->amountOwed[i] -= amount;
-            }
-            if (strcmp(temp->splitAmong[i], toUser) == 0) {
-                // Increase the owed amount for the person receiving payment
-                temp->amountOwed[i] += amount;
+void updateExpenseAfterSettlement(char *fromUser, char *toUser, Money amount) {
+    struct UserBalance *from = searchUser(fromUser);
+    struct UserBalance *to = searchUser(toUser);
+
+    // Decrease the owed amount for the person paying
+    for (int i = 0; from != NULL && i < from->slotCount; i++) {
+        expenseStore.owed[from->slots[i]] -= amount;
+    }
+    // Increase the owed amount for the person receiving payment
+    for (int i = 0; to != NULL && i < to->slotCount; i++) {
+        expenseStore.owed[to->slots[i]] += amount;
+    }
+}
+
+// FNV-1a over a string, including its terminator so concatenations stay distinct
+unsigned long long hashString(unsigned long long hash, const char *str) {
+    do {
+        hash ^= (unsigned char)*str;
+        hash *= 1099511628211ULL;
+    } while (*str++ != '\0');
+    return hash;
+}
+
+// Function to find the slot holding a node (toUser == NULL) or edge, or the empty slot for it
+struct GraphSlot* findGraphSlot(struct GraphIndex *index, unsigned long long hash, char *fromUser, char *toUser) {
+    size_t mask = index->capacity - 1;
+    size_t i = (size_t)(hash & mask);
+    while (index->slots[i].node != NULL) {
+        struct GraphSlot *slot = &index->slots[i];
+        if (slot->hash == hash && strcmp(slot->node->userName, fromUser) == 0 &&
+            (toUser == NULL || strcmp(slot->edge->toUser, toUser) == 0)) {
+            return slot;
+        }
+        i = (i + 1) & mask;
+    }
+    return &index->slots[i];
+}
+
+// Function to make room for one more entry, keeping the table at most half full
+void reserveGraphIndex(struct GraphIndex *index) {
+    if ((index->count + 1) * 2 <= index->capacity) {
+        return;
+    }
+
+    struct GraphSlot *oldSlots = index->slots;
+    size_t oldCapacity = index->capacity;
+    index->capacity = oldCapacity ? oldCapacity * 2 : 64;
+    index->slots = (struct GraphSlot *)calloc(index->capacity, sizeof(struct GraphSlot));
+
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (oldSlots[i].node != NULL) {
+            size_t mask = index->capacity - 1;
+            size_t j = (size_t)(oldSlots[i].hash & mask);
+            while (index->slots[j].node != NULL) {
+                j = (j + 1) & mask;
             }
+            index->slots[j] = oldSlots[i];
         }
-        temp = temp->next;
     }
+    free(oldSlots);
 }
 
 // Function to add debt information in the graph (adjacency list)
-void addDebtToGraph(char *fromUser, char *toUser, float amount) {
-    struct GraphNode *temp = graphHead;
-    while (temp != NULL) {
-        if (strcmp(temp->userName, fromUser) == 0) {
-            // Add an edge from fromUser to toUser
-            struct GraphEdge *newEdge = (struct GraphEdge *)malloc(sizeof(struct GraphEdge));
-            strcpy(newEdge->toUser, toUser);
-            newEdge->amount = amount;
-            newEdge->next = temp->edges;
-            temp->edges = newEdge;
-            return;
-        }
-        temp = temp->next;
+// Each (fromUser, toUser) pair has exactly one edge; repeated debts accumulate on it
+void addDebtToGraph(char *fromUser, char *toUser, Money amount) {
+    unsigned long long nodeHash = hashString(14695981039346656037ULL, fromUser);
+    unsigned long long edgeHash = hashString(nodeHash, toUser);
+
+    reserveGraphIndex(&graphEdgeIndex);
+    struct GraphSlot *edgeSlot = findGraphSlot(&graphEdgeIndex, edgeHash, fromUser, toUser);
+    if (edgeSlot->edge != NULL) {
+        edgeSlot->edge->amount += amount;
+        return;
     }
 
-    // If fromUser doesn't exist, create a new node for fromUser
-    struct GraphNode *newNode = (struct GraphNode *)malloc(sizeof(struct GraphNode));
-    strcpy(newNode->userName, fromUser);
-    newNode->edges = NULL;
-    newNode->next = graphHead;
-    graphHead = newNode;
+    reserveGraphIndex(&graphNodeIndex);
+    struct GraphSlot *nodeSlot = findGraphSlot(&graphNodeIndex, nodeHash, fromUser, NULL);
+    if (nodeSlot->node == NULL) {
+        // If fromUser doesn't exist, create a new node for fromUser
+        struct GraphNode *newNode = (struct GraphNode *)poolAlloc(&graphNodePool);
+        strcpy(newNode->userName, fromUser);
+        newNode->edges = NULL;
+        newNode->next = graphHead;
+        graphHead = newNode;
+
+        nodeSlot->hash = nodeHash;
+        nodeSlot->node = newNode;
+        graphNodeIndex.count++;
+    }
 
     // Add an edge from fromUser to toUser
-    struct GraphEdge *newEdge = (struct GraphEdge *)malloc(sizeof(struct GraphEdge));
+    struct GraphEdge *newEdge = (struct GraphEdge *)poolAlloc(&graphEdgePool);
     strcpy(newEdge->toUser, toUser);
     newEdge->amount = amount;
-    newEdge->next = newNode->edges;
-    newNode->edges = newEdge;
+    newEdge->next = nodeSlot->node->edges;
+    nodeSlot->node->edges = newEdge;
+
+    edgeSlot->hash = edgeHash;
+    edgeSlot->node = nodeSlot->node;
+    edgeSlot->edge = newEdge;
+    graphEdgeIndex.count++;
 }
 
 // Function to print the graph (debt relationships)
 void printGraph() {
-    struct GraphNode *temp = graphHead;
-    while (temp != NULL) {
-        printf("%s owes:\n", temp->userName);
-        struct GraphEdge *edge = temp->edges;
-        while (edge != NULL) {
-            printf("  - %s: %.2f\n", edge->toUser, edge->amount);
-            edge = edge->next;
+    reportBegin();
+    if (reportFormat == REPORT_CSV) {
+        reportText("from,to,amount\n");
+    } else if (reportFormat == REPORT_JSON) {
+        reportText("[");
+    }
+
+    int first = 1;
+    for (struct GraphNode *temp = graphHead; temp != NULL; temp = temp->next) {
+        if (reportFormat == REPORT_TABLE) {
+            reportText(temp->userName);
+            reportText(" owes:\n");
         }
-        temp = temp->next;
+        for (struct GraphEdge *edge = temp->edges; edge != NULL; edge = edge->next) {
+            if (reportFormat == REPORT_TABLE) {
+                reportText("  - ");
+                reportText(edge->toUser);
+                reportText(": ");
+                reportMoney(edge->amount);
+                reportText("\n");
+            } else if (reportFormat == REPORT_CSV) {
+                reportCsv(temp->userName);
+                reportText(",");
+                reportCsv(edge->toUser);
+                reportText(",");
+                reportMoney(edge->amount);
+                reportText("\n");
+            } else {
+                reportText(first ? "\n{\"from\":" : ",\n{\"from\":");
+                reportJson(temp->userName);
+                reportText(",\"to\":");
+                reportJson(edge->toUser);
+                reportText(",\"amount\":");
+                reportMoney(edge->amount);
+                reportText("}");
+            }
+            first = 0;
+        }
+    }
+
+    if (reportFormat == REPORT_JSON) {
+        reportText("\n]\n");
     }
+    reportFlush();
 }
 
 void printExpenses() {
-    struct Expense *temp = expenseHead;
+    struct ExpenseStore *store = &expenseStore;
 
-    if (temp == NULL) {
+    if (store->count == 0 && reportFormat == REPORT_TABLE) {
         printf("No expenses recorded.\n");
         return;
     }
 
-    while (temp != NULL) {
-        printf("\n--- Expense: %s ---\n", temp->description);
-        printf("Amount: %.2f paid by %s\n", temp->amount, temp->paidBy);
-        printf("Split among the following users:\n");
+    reportBegin();
+    if (reportFormat == REPORT_CSV) {
+        reportText("description,amount,payer,user,owed\n");
+    } else if (reportFormat == REPORT_JSON) {
+        reportText("[");
+    }
+
+    // Newest expense first
+    for (int row = store->count - 1; row >= 0; row--) {
+        char *description = store->descriptions + store->descriptionOffsets[row];
+        char *payer = store->payers[row]->userName;
+        long first = store->participantOffsets[row], last = store->participantOffsets[row + 1];
 
-        for (int i = 0; i < temp->userCount; i++) {
-            printf("\t%s owes %.2f\n", temp->splitAmong[i], temp->amountOwed[i]);
+        if (reportFormat == REPORT_TABLE) {
+            reportText("\n--- Expense: ");
+            reportText(description);
+            reportText(" ---\nAmount: ");
+            reportMoney(store->amounts[row]);
+            reportText(" paid by ");
+            reportText(payer);
+            reportText("\nSplit among the following users:\n");
+            for (long i = first; i < last; i++) {
+                reportText("\t");
+                reportText(store->participants[i]->userName);
+                reportText(" owes ");
+                reportMoney(store->owed[i]);
+                reportText("\n");
+            }
+        } else if (reportFormat == REPORT_CSV) {
+            // One line per participant
+            for (long i = first; i < last; i++) {
+                reportCsv(description);
+                reportText(",");
+                reportMoney(store->amounts[row]);
+                reportText(",");
+                reportCsv(payer);
+                reportText(",");
+                reportCsv(store->participants[i]->userName);
+                reportText(",");
+                reportMoney(store->owed[i]);
+                reportText("\n");
+            }
+        } else {
+            reportText(row == store->count - 1 ? "\n{\"description\":" : ",\n{\"description\":");
+            reportJson(description);
+            reportText(",\"amount\":");
+            reportMoney(store->amounts[row]);
+            reportText(",\"payer\":");
+            reportJson(payer);
+            reportText(",\"split\":[");
+            for (long i = first; i < last; i++) {
+                reportText(i == first ? "{\"user\":" : ",{\"user\":");
+                reportJson(store->participants[i]->userName);
+                reportText(",\"owed\":");
+                reportMoney(store->owed[i]);
+                reportText("}");
+            }
+            reportText("]}");
         }
+    }
 
-        temp = temp->next;  // Move to the next expense in the list
+    if (reportFormat == REPORT_JSON) {
+        reportText("\n]\n");
     }
+    reportFlush();
 }
 
+// Function to start a report in the shared buffer
+void reportBegin() {
+    if (report.data == NULL) {
+        report.data = (char *)malloc(REPORT_CAPACITY);
+    }
+    report.used = 0;
+}
+
+// Function to hand the buffered report to stdout
+void reportFlush() {
+    fwrite(report.data, 1, report.used, stdout);
+    report.used = 0;
+}
 
-// Function to add/update user balance in the BST
-struct UserBalance* addUserBalance(struct UserBalance *root, char *userName, float balanceUpdate) {
-    if (root == NULL) {
-        struct UserBalance *newNode = (struct UserBalance *)malloc(sizeof(struct UserBalance));
-        strcpy(newNode->userName, userName);
-        newNode->balance = balanceUpdate;
-        newNode->left = newNode->right = NULL;
-        return newNode;
+// Function to make room for size bytes (at most REPORT_CAPACITY) and return where they start
+char *reportReserve(long size) {
+    if (size > REPORT_CAPACITY - report.used) {
+        reportFlush();
     }
-    if (strcmp(userName, root->userName) < 0)
-        root->left = addUserBalance(root->left, userName, balanceUpdate);
-    else if (strcmp(userName, root->userName) > 0)
-        root->right = addUserBalance(root->right, userName, balanceUpdate);
-    else
-        root->balance += balanceUpdate;  // Update balance if user exists
-    return root;
+    return report.data + report.used;
 }
 
-// Function to search for a user in the BST
-struct UserBalance* searchUser(struct UserBalance *root, char *userName) {
-    if (root == NULL || strcmp(root->userName, userName) == 0)
-        return root;
-    if (strcmp(userName, root->userName) < 0)
-        return searchUser(root->left, userName);
-    return searchUser(root->right, userName);
+void reportText(const char *text) {
+    long length = strlen(text);
+    memcpy(reportReserve(length), text, length);
+    report.used += length;
 }
 
-// Function to print all user balances (in-order traversal of BST)
-void printBalances(struct UserBalance *root) {
-    if (root != NULL) {
-        printBalances(root->left);
-        printf("%s: %.2f\n", root->userName, root->balance);
-        printBalances(root->right);
+// Function to append an amount with exactly two decimals
+void reportMoney(Money amount) {
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    unsigned long long magnitude = amount < 0 ? 0ULL - (unsigned long long)amount : (unsigned long long)amount;
+    *--p = (char)('0' + magnitude % 10);
+    *--p = (char)('0' + magnitude / 10 % 10);
+    *--p = '.';
+    magnitude /= 100;
+    do {
+        *--p = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (amount < 0) {
+        *--p = '-';
     }
+    long length = digits + sizeof(digits) - p;
+    memcpy(reportReserve(length), p, length);
+    report.used += length;
+}
+
+// Function to append a CSV field, quoted only when it needs to be
+void reportCsv(const char *text) {
+    if (strpbrk(text, ",\"\r\n") == NULL) {
+        reportText(text);
+        return;
+    }
+    long length = strlen(text);
+    char *out = reportReserve(2 * length + 2), *start = out;
+    *out++ = '"';
+    for (const char *c = text; *c != '\0'; c++) {
+        if (*c == '"') {
+            *out++ = '"';
+        }
+        *out++ = *c;
+    }
+    *out++ = '"';
+    report.used += out - start;
+}
+
+// Function to append a JSON string literal
+void reportJson(const char *text) {
+    static const char hex[] = "0123456789abcdef";
+    long length = strlen(text);
+    char *out = reportReserve(6 * length + 2), *start = out;
+    *out++ = '"';
+    for (const unsigned char *c = (const unsigned char *)text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            *out++ = '\\';
+            *out++ = (char)*c;
+        } else if (*c < 0x20) {
+            memcpy(out, "\\u00", 4);
+            out[4] = hex[*c >> 4];
+            out[5] = hex[*c & 15];
+            out += 6;
+        } else {
+            *out++ = (char)*c;
+        }
+    }
+    *out++ = '"';
+    report.used += out - start;
+}
+
+
+// Function to find the first position in a node whose user sorts at or after userName
+int findInBalanceNode(struct BalanceNode *node, char *userName, int *found) {
+    int low = 0, high = node->count;
+    *found = 0;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        int cmp = strcmp(node->users[mid]->userName, userName);
+        if (cmp == 0) {
+            *found = 1;
+            return mid;
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Function to search for a user by name
+struct UserBalance* searchUser(char *userName) {
+    if (userIndex.count == 0) {
+        return NULL;
+    }
+    return findUserSlot(hashString(14695981039346656037ULL, userName), userName)->user;
+}
+
+// Function to find the slot holding a user, or the empty slot for them
+struct UserSlot* findUserSlot(unsigned long long hash, char *userName) {
+    size_t mask = userIndex.capacity - 1;
+    size_t i = (size_t)(hash & mask);
+    while (userIndex.slots[i].user != NULL) {
+        struct UserSlot *slot = &userIndex.slots[i];
+        if (slot->hash == hash && strcmp(slot->user->userName, userName) == 0) {
+            return slot;
+        }
+        i = (i + 1) & mask;
+    }
+    return &userIndex.slots[i];
+}
+
+// Function to make room for one more user, keeping the index at most half full
+void reserveUserIndex() {
+    if ((userIndex.count + 1) * 2 <= userIndex.capacity) {
+        return;
+    }
+
+    struct UserSlot *oldSlots = userIndex.slots;
+    size_t oldCapacity = userIndex.capacity;
+    userIndex.capacity = oldCapacity ? oldCapacity * 2 : 64;
+    userIndex.slots = (struct UserSlot *)calloc(userIndex.capacity, sizeof(struct UserSlot));
+
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (oldSlots[i].user != NULL) {
+            size_t mask = userIndex.capacity - 1;
+            size_t j = (size_t)(oldSlots[i].hash & mask);
+            while (userIndex.slots[j].user != NULL) {
+                j = (j + 1) & mask;
+            }
+            userIndex.slots[j] = oldSlots[i];
+        }
+    }
+    free(oldSlots);
+}
+
+// Function to split the full child i of parent, moving its middle user up
+void splitBalanceChild(struct BalanceNode *parent, int i) {
+    struct BalanceNode *full = parent->children[i];
+    struct BalanceNode *right = (struct BalanceNode *)poolAlloc(&balanceNodePool);
+    int t = BALANCE_MIN_DEGREE;
+
+    right->leaf = full->leaf;
+    right->count = t - 1;
+    memcpy(right->users, full->users + t, (t - 1) * sizeof(struct UserBalance *));
+    if (!full->leaf) {
+        memcpy(right->children, full->children + t, t * sizeof(struct BalanceNode *));
+    }
+    full->count = t - 1;
+
+    memmove(parent->children + i + 2, parent->children + i + 1, (parent->count - i) * sizeof(struct BalanceNode *));
+    memmove(parent->users + i + 1, parent->users + i, (parent->count - i) * sizeof(struct UserBalance *));
+    parent->children[i + 1] = right;
+    parent->users[i] = full->users[t - 1];
+    parent->count++;
+}
+
+// Function to add/update user balance in the B-tree; returns the user's record
+struct UserBalance* addUserBalance(char *userName, Money balanceUpdate) {
+    unsigned long long hash = hashString(14695981039346656037ULL, userName);
+    reserveUserIndex();
+    struct UserSlot *slot = findUserSlot(hash, userName);
+    if (slot->user != NULL) {
+        slot->user->balance += balanceUpdate;  // Update balance if user exists
+        return slot->user;
+    }
+
+    struct UserBalance *user = (struct UserBalance *)poolAlloc(&userPool);
+    strcpy(user->userName, userName);
+    user->balance = balanceUpdate;
+    user->slots = NULL;
+    user->slotCount = user->slotCapacity = 0;
+    slot->hash = hash;
+    slot->user = user;
+    userIndex.count++;
+
+    if (balanceRoot == NULL) {
+        balanceRoot = (struct BalanceNode *)poolAlloc(&balanceNodePool);
+        balanceRoot->count = 0;
+        balanceRoot->leaf = 1;
+    }
+    if (balanceRoot->count == BALANCE_MAX_USERS) {
+        // Grow the tree by one level
+        struct BalanceNode *newRoot = (struct BalanceNode *)poolAlloc(&balanceNodePool);
+        newRoot->count = 0;
+        newRoot->leaf = 0;
+        newRoot->children[0] = balanceRoot;
+        balanceRoot = newRoot;
+        splitBalanceChild(newRoot, 0);
+    }
+
+    // Descend to a leaf, splitting full children on the way so there is always room
+    struct BalanceNode *node = balanceRoot;
+    int found;
+    while (!node->leaf) {
+        int i = findInBalanceNode(node, userName, &found);
+        if (node->children[i]->count == BALANCE_MAX_USERS) {
+            splitBalanceChild(node, i);
+            if (strcmp(userName, node->users[i]->userName) > 0) {
+                i++;
+            }
+        }
+        node = node->children[i];
+    }
+
+    int i = findInBalanceNode(node, userName, &found);
+    memmove(node->users + i + 1, node->users + i, (node->count - i) * sizeof(struct UserBalance *));
+    node->users[i] = user;
+    node->count++;
+    return user;
+}
+
+// Function to print the balances under a B-tree node in name order
+void printBalanceNode(struct BalanceNode *node, int *first) {
+    for (int i = 0; i < node->count; i++) {
+        if (!node->leaf) {
+            printBalanceNode(node->children[i], first);
+        }
+        struct UserBalance *user = node->users[i];
+        if (reportFormat == REPORT_TABLE) {
+            reportText(user->userName);
+            reportText(": ");
+        } else if (reportFormat == REPORT_CSV) {
+            reportCsv(user->userName);
+            reportText(",");
+        } else {
+            reportText(*first ? "\n{\"user\":" : ",\n{\"user\":");
+            reportJson(user->userName);
+            reportText(",\"balance\":");
+        }
+        reportMoney(user->balance);
+        reportText(reportFormat == REPORT_JSON ? "}" : "\n");
+        *first = 0;
+    }
+    if (!node->leaf) {
+        printBalanceNode(node->children[node->count], first);
+    }
+}
+
+// Function to print all user balances in name order
+void printBalances() {
+    int first = 1;
+    reportBegin();
+    if (reportFormat == REPORT_CSV) {
+        reportText("user,balance\n");
+    } else if (reportFormat == REPORT_JSON) {
+        reportText("[");
+    }
+    if (balanceRoot != NULL) {
+        printBalanceNode(balanceRoot, &first);
+    }
+    if (reportFormat == REPORT_JSON) {
+        reportText("\n]\n");
+    }
+    reportFlush();
 }
 
 // Function to enqueue a settlement
-void enqueueSettlement(char *fromUser, char *toUser, float amount) {
-    struct Settlement *newSettlement = (struct Settlement *)malloc(sizeof(struct Settlement));
+void enqueueSettlement(char *fromUser, char *toUser, Money amount) {
+    struct Settlement *newSettlement = (struct Settlement *)poolAlloc(&settlementPool);
     strcpy(newSettlement->fromUser, fromUser);
     strcpy(newSettlement->toUser, toUser);
     newSettlement->amount = amount;
@@ -361,23 +1116,150 @@ void dequeueSettlement() {
         settlementRear = NULL;
     }
 
-    printf("Settling: %s pays %s %.2f\n", settlement->fromUser, settlement->toUser, settlement->amount);
+    char amount[24];
+    printf("Settling: %s pays %s %s\n", settlement->fromUser, settlement->toUser, formatMoney(settlement->amount, amount));
+    applySettlement(settlement->fromUser, settlement->toUser, settlement->amount);
+
+    poolFree(&settlementPool, settlement);
+}
 
+// Function to apply a settlement to balances and expenses
+void applySettlement(char *fromUser, char *toUser, Money amount) {
     // Update balances after settlement
-    balanceRoot = addUserBalance(balanceRoot, settlement->fromUser, settlement->amount);
-    balanceRoot = addUserBalance(balanceRoot, settlement->toUser, -settlement->amount);
+    addUserBalance(fromUser, amount);
+    addUserBalance(toUser, -amount);
 
     // Update expenses
-    updateExpenseAfterSettlement(settlement->fromUser, settlement->toUser, settlement->amount);
-
-    free(settlement);
+    updateExpenseAfterSettlement(fromUser, toUser, amount);
 }
 
 // Function to print all settlements in the queue
 void printSettlements() {
     struct Settlement *temp = settlementFront;
     while (temp != NULL) {
-        printf("%s pays %s %.2f\n", temp->fromUser, temp->toUser, temp->amount);
+        char amount[24];
+        printf("%s pays %s %s\n", temp->fromUser, temp->toUser, formatMoney(temp->amount, amount));
         temp = temp->next;
     }
-}
\ No newline at end of file
+}
+
+// Function to split a line in place on the delimiter; returns the field
+// count, or maxFields + 1 if the line has more fields than that
+int splitFields(char *line, char delimiter, char **fields, int maxFields) {
+    int count = 0;
+    while (count < maxFields) {
+        fields[count++] = line;
+        char *stop = strchr(line, delimiter);
+        if (stop == NULL) {
+            return count;
+        }
+        *stop = '\0';
+        line = stop + 1;
+    }
+    return maxFields + 1;
+}
+
+// Function to ingest a batch file of expenses and settlements.
+// Records, one per line, comma- or tab-separated (a tab on the first record
+// line selects TSV). Blank lines and lines starting with '#' are ignored.
+//   expense,<description>,<amount>,<payer>,<user1>,<user2>,...
+//   settle,<fromUser>,<toUser>,<amount>
+// The file is read into one buffer and split in place, so fields point
+// straight into it.
+int ingestFile(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *buffer = (char *)malloc(size + 1);
+    if (size < 0 || fread(buffer, 1, size, file) != (size_t)size) {
+        perror(path);
+        fclose(file);
+        free(buffer);
+        return 0;
+    }
+    fclose(file);
+    buffer[size] = '\0';
+
+    clock_t start = clock();
+
+    long lineNumber = 0, expenseCount = 0, settlementCount = 0, skipped = 0;
+    char delimiter = 0;
+    char *fields[53];
+    char splitAmong[50][50];
+
+    char *line = buffer;
+    while (line < buffer + size) {
+        char *eol = strchr(line, '\n');
+        char *next = eol != NULL ? eol + 1 : buffer + size;
+        if (eol != NULL) {
+            *eol = '\0';
+            if (eol > line && eol[-1] == '\r') {
+                eol[-1] = '\0';
+            }
+        }
+        lineNumber++;
+
+        if (*line == '\0' || *line == '#') {
+            line = next;
+            continue;
+        }
+        if (delimiter == 0) {
+            delimiter = strchr(line, '\t') != NULL ? '\t' : ',';
+        }
+        int count = splitFields(line, delimiter, fields, 53);
+        line = next;
+
+        Money amount;
+        int valid = 0;
+        if (strcmp(fields[0], "expense") == 0 && count >= 4 && count <= 53 &&
+            strlen(fields[1]) < 100 && strlen(fields[3]) < 50 && parseMoney(fields[2], &amount)) {
+            valid = 1;
+            for (int i = 4; i < count; i++) {
+                if (strlen(fields[i]) >= 50) {
+                    valid = 0;
+                    break;
+                }
+                strcpy(splitAmong[i - 4], fields[i]);
+            }
+            if (valid) {
+                addExpense(fields[1], amount, fields[3], splitAmong, count - 4);
+                expenseCount++;
+            }
+        }
+        else if (strcmp(fields[0], "settle") == 0 && count == 4 &&
+                 strlen(fields[1]) < 50 && strlen(fields[2]) < 50 && parseMoney(fields[3], &amount)) {
+            valid = 1;
+            applySettlement(fields[1], fields[2], amount);
+            settlementCount++;
+        }
+
+        if (!valid) {
+            fprintf(stderr, "%s:%ld: skipping malformed record\n", path, lineNumber);
+            skipped++;
+        }
+    }
+    free(buffer);
+
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("Ingested %ld expenses and %ld settlements from %s in %.3fs",
+           expenseCount, settlementCount, path, seconds);
+    if (seconds > 0) {
+        printf(" (%.0f records/s)", (expenseCount + settlementCount) / seconds);
+    }
+    printf("\n");
+    if (skipped > 0) {
+        printf("Skipped %ld malformed records.\n", skipped);
+    }
+
+    if (reportFormat == REPORT_TABLE) {
+        printf("\nUser Balances:\n");
+    }
+    printBalances();
+    return 1;
+}
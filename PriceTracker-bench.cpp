@@ -0,0 +1,317 @@
+// Benchmark harness for PriceTracker.cpp.
+//
+// Generates a synthetic ledger and times the core operations on it, printing
+// one Google-Benchmark style row per operation:
+//   PriceTracker-bench [--users N] [--expenses N] [--fanout N] [--settlements N] [--seed N]
+// --fanout is the number of debtors per expense; --settlements is how many
+// settlements are queued and processed after the expenses are added, one at
+// a time, then as one batch, then concurrently through the background
+// settlement processor. The BM_Core rows repeat the expenses and settlements
+// on the bare ledger core for several amount, user key and container policy
+// combinations.
+//
+// The tracker's own output (processing and report printing) goes to
+// /dev/null; the results table is written to the original stdout.
+#define PRICETRACKER_NO_MAIN
+#include "PriceTracker.cpp"
+
+#include <cstdio>
+#include <ctime>
+
+struct BenchConfig {
+    size_t users = 10000;
+    size_t expenses = 200000;
+    size_t fanout = 4;
+    size_t settlements = 20000;
+    uint64_t seed = 42;
+};
+
+// Small deterministic generator so runs are comparable
+struct BenchRandom {
+    uint64_t state;
+    uint64_t next() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return state >> 33;
+    }
+    size_t below(size_t n) { return next() % n; }
+};
+
+FILE *benchOut = stdout;
+const Timestamp BENCH_EPOCH = 1700000000;          // Expenses are stamped a minute apart from here
+
+double cpuSeconds() {
+    return static_cast<double>(clock()) / CLOCKS_PER_SEC;
+}
+
+void reportHeader() {
+    fprintf(benchOut, "%-40s %15s %15s %12s %15s\n", "Benchmark", "Time", "CPU", "Iterations", "Items/s");
+    fprintf(benchOut, "%s\n", string(101, '-').c_str());
+}
+
+template <typename Body>
+void runBenchmark(const string &name, size_t iterations, Body body) {
+    cout.flush();
+    auto wallStart = chrono::steady_clock::now();
+    double cpuStart = cpuSeconds();
+    body();
+    cout.flush();
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - wallStart).count();
+    double cpu = cpuSeconds() - cpuStart;
+
+    size_t n = max<size_t>(iterations, 1);
+    fprintf(benchOut, "%-40s %12.0f ns %12.0f ns %12zu %15.0f\n", name.c_str(),
+            wall * 1e9 / n, cpu * 1e9 / n, iterations, wall > 0 ? iterations / wall : 0.0);
+}
+
+// The ledger core alone (no expense rows, journal, history or timers) for
+// one policy combination: the expenses, then the settlements one at a time.
+// The splits are converted to Amount before the clock starts.
+template <typename Amount, typename UserKey, template <typename, typename> class BalancePolicy,
+          template <typename, typename> class GraphPolicy>
+void benchLedgerCore(const string &label, size_t users, const vector<UserId> &payers, const vector<Money> &amounts,
+                     const vector<vector<UserId>> &debtors, const vector<Settlement> &pending) {
+    vector<UserKey> participants;
+    vector<Amount> owed;
+    vector<size_t> offsets = {0};
+    vector<Money> split;
+    for (size_t e = 0; e < payers.size(); ++e) {
+        splitEvenly(amounts[e], debtors[e].size() + 1, split);
+        participants.push_back(static_cast<UserKey>(payers[e]));
+        owed.push_back(Amount());
+        for (size_t d = 0; d < debtors[e].size(); ++d) {
+            participants.push_back(static_cast<UserKey>(debtors[e][d]));
+            owed.push_back(static_cast<Amount>(split[d + 1]));
+        }
+        offsets.push_back(participants.size());
+    }
+
+    LedgerCore<Amount, UserKey, BalancePolicy, GraphPolicy> core;
+    CowColumn<Amount> owedColumn;
+    for (size_t i = 0; i < users; ++i) core.addUser(static_cast<UserKey>(i));
+
+    runBenchmark("BM_CoreAddExpense/" + label, payers.size(), [&]() {
+        for (size_t e = 0; e < payers.size(); ++e) {
+            size_t first = offsets[e], count = offsets[e + 1] - first;
+            owedColumn.append(owed.data() + first, count);
+            core.addExpense(participants[first], participants.data() + first, owed.data() + first, count, first);
+        }
+    });
+    runBenchmark("BM_CoreSettlement/" + label, pending.size(), [&]() {
+        for (const auto &s : pending) {
+            core.applySettlement(static_cast<UserKey>(s.fromUser), static_cast<UserKey>(s.toUser),
+                                 static_cast<Amount>(s.amount), owedColumn);
+        }
+    });
+}
+
+bool parseArgs(int argc, char *argv[], BenchConfig &config) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        uint64_t value = strtoull(argv[++i], nullptr, 10);
+        if (arg == "--users") config.users = value;
+        else if (arg == "--expenses") config.expenses = value;
+        else if (arg == "--fanout") config.fanout = value;
+        else if (arg == "--settlements") config.settlements = value;
+        else if (arg == "--seed") config.seed = value;
+        else return false;
+    }
+    return config.users > config.fanout;
+}
+
+int main(int argc, char *argv[]) {
+    BenchConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        cerr << "Usage: " << argv[0]
+             << " [--users N] [--expenses N] [--fanout N] [--settlements N] [--seed N]\n"
+             << "(--users must exceed --fanout)\n";
+        return 1;
+    }
+
+    // Keep the results on the real stdout and silence the tracker
+    benchOut = fdopen(dup(STDOUT_FILENO), "w");
+    if (benchOut == nullptr || freopen("/dev/null", "w", stdout) == nullptr) {
+        perror("redirect stdout");
+        return 1;
+    }
+
+    LedgerScope scope(ledgers.get(DEFAULT_GROUP));
+
+    // Generate the workload up front so only ledger work is timed
+    BenchRandom random = {config.seed};
+    vector<UserId> ids;
+    for (size_t i = 0; i < config.users; ++i) ids.push_back(internUser("user" + to_string(i)));
+
+    vector<UserId> payers(config.expenses);
+    vector<Money> amounts(config.expenses);
+    vector<Timestamp> times(config.expenses);
+    vector<vector<UserId>> debtors(config.expenses);
+    for (size_t e = 0; e < config.expenses; ++e) {
+        payers[e] = ids[random.below(config.users)];
+        amounts[e] = 100 + static_cast<Money>(random.below(100000));
+        times[e] = BENCH_EPOCH + static_cast<Timestamp>(e) * 60;
+        while (debtors[e].size() < config.fanout) {
+            UserId debtor = ids[random.below(config.users)];
+            if (debtor != payers[e] && find(debtors[e].begin(), debtors[e].end(), debtor) == debtors[e].end())
+                debtors[e].push_back(debtor);
+        }
+    }
+
+    vector<Settlement> pending(config.settlements);
+    for (auto &s : pending) {
+        s.fromUser = ids[random.below(config.users)];
+        do s.toUser = ids[random.below(config.users)]; while (s.toUser == s.fromUser);
+        s.amount = 100 + static_cast<Money>(random.below(5000));
+        s.time = BENCH_EPOCH + static_cast<Timestamp>(random.below(config.expenses)) * 60;
+    }
+
+    fprintf(benchOut, "PriceTracker.cpp: users=%zu expenses=%zu fanout=%zu settlements=%zu seed=%llu\n\n",
+            config.users, config.expenses, config.fanout, config.settlements,
+            static_cast<unsigned long long>(config.seed));
+    reportHeader();
+
+    runBenchmark("BM_AddExpense", config.expenses, [&]() {
+        for (size_t e = 0; e < config.expenses; ++e)
+            recordExpense("bench expense", amounts[e], payers[e], debtors[e], times[e]);
+    });
+
+    // Share computation alone for one large weighted split
+    const size_t splitUsers = 4096, splitRounds = 1000;
+    vector<double> weights(splitUsers);
+    vector<Money> shares(splitUsers);
+    for (auto &w : weights) w = 1 + static_cast<double>(random.below(1000)) / 100;
+    runBenchmark("BM_WeightedSplit/" + to_string(splitUsers), splitUsers * splitRounds, [&]() {
+        for (size_t i = 0; i < splitRounds; ++i)
+            splitByWeight(100000 + static_cast<Money>(i), weights.data(), splitUsers, shares.data());
+    });
+
+    for (const auto &s : pending) ledger->settlements.push(s);
+    runBenchmark("BM_ProcessSettlement", config.settlements, [&]() {
+        for (size_t i = 0; i < config.settlements; ++i) processSettlement();
+    });
+
+    for (const auto &s : pending) ledger->settlements.push(s);
+    runBenchmark("BM_ProcessAllSettlements", config.settlements, []() { processAllSettlements(); });
+
+    // The same settlements again, submitted from several threads at once and
+    // applied by the background worker; timed until the ring is drained
+    size_t producers = max(2u, thread::hardware_concurrency());
+    runBenchmark("BM_ConcurrentSettlement/" + to_string(producers), config.settlements, [&]() {
+        startSettlementWorker();
+        vector<thread> threads;
+        for (size_t p = 0; p < producers; ++p) {
+            threads.emplace_back([&, p]() {
+                for (size_t i = p; i < pending.size(); i += producers) submitSettlement(pending[i]);
+            });
+        }
+        for (auto &t : threads) t.join();
+        stopSettlementWorker();
+    });
+
+    const size_t topQueries = 10000;
+    runBenchmark("BM_TopBalances/10", topQueries, [&]() {
+        for (size_t i = 0; i < topQueries; ++i) printTopBalances(10);
+    });
+    // Cost of the instrumentation itself: an enabled timer around nothing
+    const size_t timedOperations = 10000000;
+    statsEnabled = true;
+    runBenchmark("BM_OperationTimer", timedOperations, [&]() {
+        for (size_t i = 0; i < timedOperations; ++i) OperationTimer timer(Operation::UpdateExpense);
+    });
+    statsEnabled = false;
+
+    // The first query builds the time index and its checkpoints
+    const size_t asOfQueries = 1000;
+    vector<Money> balancesAsOf;
+    runBenchmark("BM_BalancesAsOf", asOfQueries, [&]() {
+        ExpenseHistory &history = ledger->history;
+        for (size_t i = 0; i < asOfQueries; ++i) {
+            Timestamp time = BENCH_EPOCH + static_cast<Timestamp>(random.below(config.expenses)) * 60;
+            history.sync(ledger->expenses, ledger->settledLog, ledger->users.size());
+            history.balancesAt(history.position(time), ledger->expenses, ledger->settledLog,
+                               ledger->users.size(), balancesAsOf);
+        }
+    });
+    const size_t userQueries = 10000;
+    runBenchmark("BM_UserExpenses", userQueries, [&]() {
+        for (size_t i = 0; i < userQueries; ++i) printUserExpenses(ids[random.below(config.users)], false);
+    });
+    // Request handling in server mode, without the socket: parse, apply, answer
+    const size_t serveRequests = 100000;
+    string response;
+    runBenchmark("BM_ServeRequest", serveRequests, [&]() {
+        Ledger *group = ledger;
+        bool quit = false;
+        vector<Settlement> submitted;
+        for (size_t i = 0; i < serveRequests; ++i) {
+            response.clear();
+            serveRequest(i % 2 ? "balance,user" + to_string(random.below(config.users))
+                               : "expense,bench expense,12.34,user" + to_string(random.below(config.users)) + ",user0",
+                         group, response, quit, submitted);
+        }
+    });
+    runBenchmark("BM_PrintBalances", ledger->users.size(), []() { printBalances(); });
+    runBenchmark("BM_PrintGraph", ledger->debtGraph.size(), []() { printGraph(); });
+    runBenchmark("BM_PrintExpenses", ledger->expenses.size(), []() { printExpenses(); });
+    runBenchmark("BM_CancelDebtCycles", ledger->debtGraph.size(), []() { cancelDebtCycles(); });
+
+    // Writers while another thread keeps printing reports from views; the
+    // reader only holds the ledger lock long enough to take each view
+    const size_t contendedExpenses = 20000;
+    runBenchmark("BM_AddExpenseDuringReports", contendedExpenses, [&]() {
+        atomic<bool> done{false};
+        Ledger &group = *ledger;
+        thread reader([&]() {
+            LedgerScope readerScope(group);
+            while (!done.load(memory_order_relaxed)) printBalances();
+        });
+        for (size_t i = 0; i < contendedExpenses; ++i) {
+            size_t e = random.below(config.expenses);
+            lock_guard<mutex> lock(ledger->lock);
+            recordExpense("bench expense", amounts[e], payers[e], debtors[e], times[e]);
+        }
+        done = true;
+        reader.join();
+    });
+
+    // The same expenses spread over independent groups, one pool task per
+    // group; ids are reused, so each group first interns the same users
+    const size_t groups = 64;
+    const UserTable &names = ledger->users;
+    ThreadPool pool(max(1u, thread::hardware_concurrency()));
+    runBenchmark("BM_ParallelGroups/" + to_string(groups) + "/" + to_string(pool.size()), config.expenses, [&]() {
+        for (size_t g = 0; g < groups; ++g) {
+            pool.submit([&, g]() {
+                LedgerScope groupScope(ledgers.get("bench" + to_string(g)));
+                lock_guard<mutex> lock(ledger->lock);
+                for (size_t i = 0; i < config.users; ++i) internUser(names.name(static_cast<UserId>(i)));
+                for (size_t e = g; e < config.expenses; e += groups)
+                    recordExpense("bench expense", amounts[e], payers[e], debtors[e], times[e]);
+            });
+        }
+        pool.wait();
+    });
+
+    // Ledger core policy combinations: amount/user key/balances/graph. The
+    // first is what Ledger uses; the last two are the original float and map
+    // layout and a 16-bit user key.
+    benchLedgerCore<Money, UserId, RankedBalances, IndexedDebtGraph>("i64/u32/ranked/indexed", config.users,
+                                                                     payers, amounts, debtors, pending);
+    benchLedgerCore<Money, UserId, DenseBalances, IndexedDebtGraph>("i64/u32/dense/indexed", config.users,
+                                                                    payers, amounts, debtors, pending);
+    benchLedgerCore<Money, UserId, DenseBalances, HashedDebtGraph>("i64/u32/dense/hashed", config.users,
+                                                                   payers, amounts, debtors, pending);
+    benchLedgerCore<Money, UserId, OrderedBalances, OrderedDebtGraph>("i64/u32/ordered/ordered", config.users,
+                                                                      payers, amounts, debtors, pending);
+    benchLedgerCore<double, UserId, DenseBalances, IndexedDebtGraph>("f64/u32/dense/indexed", config.users,
+                                                                     payers, amounts, debtors, pending);
+    benchLedgerCore<float, UserId, OrderedBalances, OrderedDebtGraph>("f32/u32/ordered/ordered", config.users,
+                                                                      payers, amounts, debtors, pending);
+    if (config.users <= 0x10000) {
+        benchLedgerCore<Money, uint16_t, DenseBalances, IndexedDebtGraph>("i64/u16/dense/indexed", config.users,
+                                                                          payers, amounts, debtors, pending);
+    }
+
+    fclose(benchOut);
+    return 0;
+}
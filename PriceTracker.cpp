@@ -5,257 +5,4127 @@
 #include <map>
 #include <memory>
 #include <iomanip>
+#include <unordered_map>
+#include <string_view>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <cerrno>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdio>
+#include <cctype>
+#include <cmath>
+#include <ctime>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#if defined(__linux__)
+#include <csignal>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#endif
 using namespace std;
 
+using UserId = uint32_t;
+using Money = int64_t;     // Amounts in minor units (cents)
+using Timestamp = int64_t; // Seconds since the Unix epoch, UTC
+
+// ------------------------------
+// Structures & Classes
+// ------------------------------
+
+struct Settlement {
+    UserId fromUser;
+    UserId toUser;
+    Money amount;
+    Timestamp time;
+};
+
+struct UserBalance {
+    string userName;
+    Money balance = 0;
+};
+
+template <typename Amount, typename UserKey>
+struct BasicGraphEdge {
+    UserKey fromUser;
+    UserKey toUser;
+    Amount amount;
+};
+using GraphEdge = BasicGraphEdge<Money, UserId>;
+
+struct GraphNode {
+    string userName;
+    vector<GraphEdge> edges;
+};
+
+// Counts from one batch ingestion
+struct IngestStats {
+    size_t expenseCount = 0;
+    size_t settlementCount = 0;
+    size_t skipped = 0;
+    double seconds = 0;
+};
+
+// Result of one cycle cancellation pass over the debt graph
+struct CycleStats {
+    size_t cycles = 0;
+    size_t edgesRemoved = 0;
+    Money weightRemoved = 0;                       // Total amount taken off the edges
+    double seconds = 0;
+};
+
+// How an itemized expense is divided: evenly over the listed users, in
+// proportion to each user's weight, share count or percentage, or by each
+// user's exact amount
+enum class SplitKind { Equal, Weights, Shares, Percent, Exact };
+const char *const SPLIT_KIND_NAMES[] = {"equal", "weights", "shares", "percent", "exact"};
+
+// An itemized split as entered, one entry per user. The columns are kept
+// apart so the share kernel walks one contiguous array of weights.
+struct SplitSpec {
+    SplitKind kind = SplitKind::Equal;
+    vector<UserId> users;
+    vector<double> weights;                        // Weights, share counts or percentages
+    vector<Money> amounts;                         // Exact amounts (Exact only)
+};
+
+// Column of trivially copyable values stored in fixed-size chunks shared
+// copy-on-write with read views. view() copies only the chunk pointers, so
+// it costs one reference per chunk however long the column is. A write to a
+// chunk that a view still holds clones that chunk first, so views never see
+// a later change. Reads through operator[] are plain; writes go through
+// edit() and the append calls. One writer at a time (under the ledger lock);
+// views may be read from any thread.
+template <typename T>
+class CowColumn {
+public:
+    static constexpr size_t CHUNK_SIZE = 32768 / sizeof(T);
+    static_assert((CHUNK_SIZE & (CHUNK_SIZE - 1)) == 0, "chunk size must be a power of two");
+
+    struct Chunk {
+        T items[CHUNK_SIZE];
+    };
+
+    // Immutable view of the column as it was when taken
+    struct View {
+        vector<shared_ptr<const Chunk>> chunks;
+        size_t count = 0;
+
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        const T &operator[](size_t i) const { return chunks[i / CHUNK_SIZE]->items[i % CHUNK_SIZE]; }
+    };
+
+    CowColumn() = default;
+    CowColumn(initializer_list<T> values) { for (const T &value : values) push_back(value); }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T &operator[](size_t i) const { return chunks[i / CHUNK_SIZE]->items[i % CHUNK_SIZE]; }
+    View view() const {
+        fill(writable.begin(), writable.end(), nullptr);
+        return View{vector<shared_ptr<const Chunk>>(chunks.begin(), chunks.end()), count};
+    }
+
+    T &edit(size_t i) {
+        T *items = writable[i / CHUNK_SIZE];
+        if (items == nullptr) items = makeWritable(i / CHUNK_SIZE);
+        return items[i % CHUNK_SIZE];
+    }
+
+    void push_back(const T &value) {
+        reserveChunks(count + 1);
+        edit(count) = value;
+        count++;
+    }
+
+    void append(const T *values, size_t n) {
+        reserveChunks(count + n);
+        while (n > 0) {
+            size_t offset = count % CHUNK_SIZE, run = min(n, CHUNK_SIZE - offset);
+            memcpy(&edit(count), values, run * sizeof(T));
+            count += run;
+            values += run;
+            n -= run;
+        }
+    }
+
+    void append(size_t n, const T &value) {
+        reserveChunks(count + n);
+        while (n > 0) {
+            size_t offset = count % CHUNK_SIZE, run = min(n, CHUNK_SIZE - offset);
+            fill_n(&edit(count), run, value);
+            count += run;
+            n -= run;
+        }
+    }
+
+    void resize(size_t n, const T &value = T()) {
+        if (n > count) {
+            append(n - count, value);
+            return;
+        }
+        count = n;
+        chunks.resize((n + CHUNK_SIZE - 1) / CHUNK_SIZE);
+        writable.resize(chunks.size());
+    }
+
+    void assign(const T *values, size_t n) {
+        chunks.clear();
+        writable.clear();
+        backing.reset();
+        count = 0;
+        append(values, n);
+    }
+
+    // Like assign, but whole chunks are shared with storage that owner keeps
+    // alive (a mapped snapshot) instead of copied. Since owner is held too,
+    // such a chunk is always cloned on its first write. The tail that does
+    // not fill a chunk is copied.
+    void assignShared(shared_ptr<const void> owner, const T *values, size_t n) {
+        chunks.clear();
+        writable.clear();
+        backing = move(owner);
+        for (count = 0; n - count >= CHUNK_SIZE; count += CHUNK_SIZE) {
+            chunks.emplace_back(backing, const_cast<Chunk *>(reinterpret_cast<const Chunk *>(values + count)));
+            writable.push_back(nullptr);
+        }
+        append(values + count, n - count);
+    }
+
+    // Calls f(data, count) for each run of contiguous elements, in order
+    template <typename F>
+    void forEachSpan(F f) const {
+        for (size_t first = 0; first < count; first += CHUNK_SIZE)
+            f(chunks[first / CHUNK_SIZE]->items, min(CHUNK_SIZE, count - first));
+    }
+
+private:
+    vector<shared_ptr<Chunk>> chunks;
+    mutable vector<T *> writable;                  // Items of chunks known to be in no view, else null; cleared by view()
+    shared_ptr<const void> backing;                // Storage of chunks taken by assignShared
+    size_t count = 0;
+
+    void reserveChunks(size_t n) {
+        while (chunks.size() * CHUNK_SIZE < n) {
+            chunks.emplace_back(new Chunk);
+            writable.push_back(chunks.back()->items);
+        }
+    }
+
+    T *makeWritable(size_t index) {
+        shared_ptr<Chunk> &chunk = chunks[index];
+        if (chunk.use_count() > 1) {
+            chunk = make_shared<Chunk>(*chunk);
+        } else {
+            // Pairs with the release of the last view's reference, so its
+            // reads of this chunk happen before the write
+            atomic_thread_fence(memory_order_acquire);
+        }
+        return writable[index] = chunk->items;
+    }
+};
+
+// Columnar expense ledger. Per-expense columns are indexed by expense row;
+// the split lists of all expenses sit back to back in one participant arena,
+// and expense i owns arena slots [participantOffsets[i], participantOffsets[i + 1]).
+// Slot 0 of every expense is the payer. The columns the reports read are
+// chunked copy-on-write (see CowColumn), so adding an expense never
+// allocates on its own or moves what a report is reading. slotRows and
+// shares are only used under the ledger lock and are never viewed; they are
+// chunked too so that they can share a mapped snapshot (see loadSnapshot).
+struct ExpenseStore {
+    CowColumn<Money> amounts;
+    CowColumn<UserId> payers;
+    CowColumn<Timestamp> times;
+    CowColumn<uint64_t> participantOffsets = {0};
+    CowColumn<uint64_t> descriptionOffsets = {0};
+    CowColumn<UserId> participants;                // Participant arena
+    CowColumn<uint64_t> slotRows;                  // Expense row owning each slot, parallel to participants
+    CowColumn<Money> owed;                         // Amount owed, parallel to participants
+    CowColumn<Money> shares;                       // Original split, parallel to participants
+    CowColumn<char> descriptions;                  // Description arena
+
+    // The report columns as they are now
+    struct View {
+        CowColumn<Money>::View amounts;
+        CowColumn<UserId>::View payers;
+        CowColumn<Timestamp>::View times;
+        CowColumn<uint64_t>::View participantOffsets;
+        CowColumn<uint64_t>::View descriptionOffsets;
+        CowColumn<UserId>::View participants;
+        CowColumn<Money>::View owed;
+        CowColumn<char>::View descriptions;
+
+        size_t size() const { return amounts.size(); }
+        bool empty() const { return amounts.empty(); }
+        string_view description(size_t row, string &scratch) const {
+            return ExpenseStore::description(descriptions, descriptionOffsets, row, scratch);
+        }
+    };
+
+    size_t size() const { return amounts.size(); }
+    bool empty() const { return amounts.empty(); }
+
+    View view() const {
+        return View{amounts.view(), payers.view(), times.view(), participantOffsets.view(),
+                    descriptionOffsets.view(), participants.view(), owed.view(), descriptions.view()};
+    }
+
+    // A description that straddles two chunks is copied into scratch
+    template <typename Chars, typename Offsets>
+    static string_view description(const Chars &chars, const Offsets &offsets, size_t row, string &scratch) {
+        uint64_t begin = offsets[row], end = offsets[row + 1];
+        if (begin == end) return string_view();
+        const size_t chunk = CowColumn<char>::CHUNK_SIZE;
+        if (begin / chunk == (end - 1) / chunk) return string_view(&chars[begin], end - begin);
+        scratch.clear();
+        for (uint64_t i = begin; i < end; ++i) scratch.push_back(chars[i]);
+        return scratch;
+    }
+
+    string_view description(size_t row, string &scratch) const {
+        return description(descriptions, descriptionOffsets, row, scratch);
+    }
+
+    size_t append(string_view description, Money amount, UserId paidBy, Timestamp time,
+                  const UserId *users, const Money *amountsOwed, size_t count) {
+        amounts.push_back(amount);
+        payers.push_back(paidBy);
+        times.push_back(time);
+        participants.append(users, count);
+        slotRows.append(count, amounts.size() - 1);
+        owed.append(amountsOwed, count);
+        shares.append(amountsOwed, count);
+        participantOffsets.push_back(participants.size());
+        descriptions.append(description.data(), description.size());
+        descriptionOffsets.push_back(descriptions.size());
+        return amounts.size() - 1;
+    }
+};
+
+struct UserTable {
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    vector<unique_ptr<char[]>> blocks;
+    char *block = nullptr;
+    size_t blockUsed = BLOCK_SIZE;
+    CowColumn<string_view> names;                  // UserId -> name (the blocks never move)
+    vector<uint64_t> ids;                          // name -> UserId, see slotFor
+
+    // The names as they are now
+    struct View {
+        CowColumn<string_view>::View names;
+        string_view name(UserId id) const { return names[id]; }
+        size_t size() const { return names.size(); }
+    };
+
+    static constexpr uint64_t EMPTY = ~0ULL;
+
+    static uint32_t hashName(string_view name) {
+        uint64_t h = hash<string_view>()(name);
+        return static_cast<uint32_t>(h ^ (h >> 32));
+    }
+
+    // ids is an open-addressing table whose slots hold a name's hash in the
+    // high half and its UserId in the low half, so a probe only compares
+    // names whose hashes match and the table grows without rehashing them.
+    // Returns the slot holding name, or the empty slot where it would go.
+    size_t slotFor(string_view name, uint32_t nameHash) const {
+        size_t mask = ids.size() - 1;
+        for (size_t i = nameHash & mask;; i = (i + 1) & mask) {
+            if (ids[i] == EMPTY) return i;
+            if (ids[i] >> 32 == nameHash && names[static_cast<UserId>(ids[i])] == name) return i;
+        }
+    }
+
+    void growIds() {
+        vector<uint64_t> grown(max<size_t>(1024, ids.size() * 2), EMPTY);
+        size_t mask = grown.size() - 1;
+        for (uint64_t entry : ids) {
+            if (entry == EMPTY) continue;
+            size_t i = (entry >> 32) & mask;
+            while (grown[i] != EMPTY) i = (i + 1) & mask;
+            grown[i] = entry;
+        }
+        ids = move(grown);
+    }
+
+    bool find(string_view name, UserId &id) const {
+        if (ids.empty()) return false;
+        uint64_t entry = ids[slotFor(name, hashName(name))];
+        if (entry == EMPTY) return false;
+        id = static_cast<UserId>(entry);
+        return true;
+    }
+
+    UserId intern(string_view name) {
+        if ((names.size() + 1) * 2 > ids.size()) growIds();
+        uint32_t nameHash = hashName(name);
+        size_t slot = slotFor(name, nameHash);
+        if (ids[slot] != EMPTY) return static_cast<UserId>(ids[slot]);
+
+        char *dest;
+        if (name.size() > BLOCK_SIZE) {
+            // Oversized names get a block of their own
+            blocks.emplace_back(new char[name.size()]);
+            dest = blocks.back().get();
+        } else {
+            if (!block || name.size() > BLOCK_SIZE - blockUsed) {
+                blocks.emplace_back(new char[BLOCK_SIZE]);
+                block = blocks.back().get();
+                blockUsed = 0;
+            }
+            dest = block + blockUsed;
+            blockUsed += name.size();
+        }
+        memcpy(dest, name.data(), name.size());
+
+        UserId id = static_cast<UserId>(names.size());
+        names.push_back(string_view(dest, name.size()));
+        ids[slot] = static_cast<uint64_t>(nameHash) << 32 | id;
+        return id;
+    }
+
+    string_view name(UserId id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+    View view() const { return View{names.view()}; }
+};
+
+// Open-addressing map from a (fromUser, toUser) pair to its edge position.
+// Probes stay inside one flat array, so updates are O(1) amortized. The
+// table is either its own or, after a snapshot load, the one stored in the
+// (privately) mapped snapshot, which is updated in place until it grows.
+struct EdgeIndex {
+    static constexpr uint64_t EMPTY = ~0ULL;
+
+    uint64_t *keys = nullptr;                      // capacity entries
+    uint32_t *values = nullptr;
+    size_t capacity = 0;
+    size_t count = 0;
+    vector<uint64_t> keyStorage;                   // The table, when it is its own
+    vector<uint32_t> valueStorage;
+    shared_ptr<const void> backing;                // The mapping, when it is not
+
+    EdgeIndex() = default;
+    EdgeIndex(const EdgeIndex &) = delete;
+    EdgeIndex &operator=(const EdgeIndex &) = delete;
+    EdgeIndex(EdgeIndex &&) = default;
+    EdgeIndex &operator=(EdgeIndex &&) = default;
+
+    static uint64_t key(UserId fromUser, UserId toUser) {
+        return (static_cast<uint64_t>(fromUser) << 32) | toUser;
+    }
+
+    size_t probe(uint64_t k) const {
+        size_t mask = capacity - 1;
+        size_t i = static_cast<size_t>((k * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+        while (keys[i] != EMPTY && keys[i] != k) i = (i + 1) & mask;
+        return i;
+    }
+
+    bool find(uint64_t k, uint32_t &value) const {
+        if (capacity == 0) return false;
+        size_t i = probe(k);
+        if (keys[i] == EMPTY) return false;
+        value = values[i];
+        return true;
+    }
+
+    void insert(uint64_t k, uint32_t value) {
+        if ((count + 1) * 2 > capacity) grow();
+        size_t i = probe(k);
+        if (keys[i] == EMPTY) count++;
+        keys[i] = k;
+        values[i] = value;
+    }
+
+    void grow() {
+        uint64_t *oldKeys = keys;
+        uint32_t *oldValues = values;
+        size_t oldCapacity = capacity;
+        vector<uint64_t> grownKeys(max<size_t>(16, capacity * 2), EMPTY);
+        vector<uint32_t> grownValues(grownKeys.size(), 0);
+        keys = grownKeys.data();
+        values = grownValues.data();
+        capacity = grownKeys.size();
+        for (size_t i = 0; i < oldCapacity; ++i) {
+            if (oldKeys[i] == EMPTY) continue;
+            size_t j = probe(oldKeys[i]);
+            keys[j] = oldKeys[i];
+            values[j] = oldValues[i];
+        }
+        keyStorage = move(grownKeys);
+        valueStorage = move(grownValues);
+        backing.reset();
+    }
+
+    // Uses a table of slots entries holding count keys, which owner keeps
+    // mapped and writable, in place
+    void assignShared(shared_ptr<const void> owner, uint64_t *tableKeys, uint32_t *tableValues, size_t slots,
+                      size_t entries) {
+        keyStorage.clear();
+        valueStorage.clear();
+        backing = move(owner);
+        keys = tableKeys;
+        values = tableValues;
+        capacity = slots;
+        count = entries;
+    }
+};
+
+// Max-heap of users keyed by sign * balance. Each user's heap position is
+// tracked, so a changed balance is re-sifted in O(log U) instead of the
+// whole table being sorted per query. With sign = 1 the top is the largest
+// creditor; with sign = -1 it is the largest debtor.
+struct BalanceHeap {
+    Money sign;
+    vector<Money> keys;                            // Heap order
+    vector<UserId> heapUsers;                      // Heap order
+    vector<uint32_t> position;                     // UserId -> heap index
+
+    explicit BalanceHeap(Money sign) : sign(sign) {}
+
+    void add(UserId user, Money balance) {
+        if (user >= position.size()) position.resize(user + 1);
+        keys.push_back(sign * balance);
+        heapUsers.push_back(user);
+        position[user] = static_cast<uint32_t>(keys.size() - 1);
+        siftUp(keys.size() - 1);
+    }
+
+    void update(UserId user, Money balance) {
+        size_t i = position[user];
+        Money key = sign * balance;
+        Money old = keys[i];
+        keys[i] = key;
+        if (key > old) siftUp(i);
+        else if (key < old) siftDown(i);
+    }
+
+    // Appends up to k users with a positive key, best first. Only the heap
+    // frontier is explored, so this costs O(k log k) whatever the user count.
+    void top(size_t k, vector<UserId> &out) const {
+        priority_queue<pair<Money, uint32_t>> frontier;
+        if (!keys.empty() && keys[0] > 0) frontier.push({keys[0], 0});
+        while (!frontier.empty() && k-- > 0) {
+            uint32_t i = frontier.top().second;
+            frontier.pop();
+            out.push_back(heapUsers[i]);
+            for (size_t child = 2 * i + 1; child <= 2 * i + 2 && child < keys.size(); ++child) {
+                if (keys[child] > 0) frontier.push({keys[child], static_cast<uint32_t>(child)});
+            }
+        }
+    }
+
+    void swapEntries(size_t a, size_t b) {
+        swap(keys[a], keys[b]);
+        swap(heapUsers[a], heapUsers[b]);
+        position[heapUsers[a]] = static_cast<uint32_t>(a);
+        position[heapUsers[b]] = static_cast<uint32_t>(b);
+    }
+
+    void siftUp(size_t i) {
+        while (i > 0 && keys[(i - 1) / 2] < keys[i]) {
+            swapEntries(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+    void siftDown(size_t i) {
+        while (true) {
+            size_t largest = i, left = 2 * i + 1, right = left + 1;
+            if (left < keys.size() && keys[left] > keys[largest]) largest = left;
+            if (right < keys.size() && keys[right] > keys[largest]) largest = right;
+            if (largest == i) return;
+            swapEntries(i, largest);
+            i = largest;
+        }
+    }
+};
+
+// Time-ordered index over a ledger's expenses and applied settlements.
+// Events are pulled in from the expense columns and the settlement log by
+// sync(), so every path that records them (menu, ingestion, replay,
+// snapshot load) is covered without hooks. Every `interval` events a full
+// copy of the balances is kept, so the balances as of any time cost a
+// binary search, one checkpoint copy and a replay of at most one interval.
+struct ExpenseHistory {
+    struct Event {
+        Timestamp time;
+        uint64_t ref;                              // Row or settledLog index << 1, low bit set for settlements
+
+        bool isSettlement() const { return ref & 1; }
+        size_t index() const { return ref >> 1; }
+    };
+
+    static constexpr size_t MIN_INTERVAL = 4096;
+
+    vector<Event> events;                          // Ordered by time, ties in recording order
+    size_t indexedExpenses = 0;
+    size_t indexedSettlements = 0;
+    size_t interval = MIN_INTERVAL;                // Events between checkpoints
+    vector<vector<Money>> checkpoints;             // [c]: balances after the first c * interval events
+
+    void sync(const ExpenseStore &expenses, const vector<Settlement> &settled, size_t userCount) {
+        // Checkpoints cost userCount each, so space them at least that far apart
+        size_t wanted = MIN_INTERVAL;
+        while (wanted < userCount) wanted *= 2;
+        if (wanted != interval) {
+            interval = wanted;
+            checkpoints.clear();
+        }
+
+        size_t known = events.size();
+        for (; indexedExpenses < expenses.size(); ++indexedExpenses)
+            events.push_back({expenses.times[indexedExpenses], indexedExpenses << 1});
+        for (; indexedSettlements < settled.size(); ++indexedSettlements)
+            events.push_back({settled[indexedSettlements].time, (indexedSettlements << 1) | 1});
+        if (events.size() == known) return;
+
+        auto byTime = [](const Event &a, const Event &b) { return a.time < b.time; };
+        auto middle = events.begin() + known;
+        stable_sort(middle, events.end(), byTime);
+        if (known == 0 || middle[-1].time <= middle->time) return; // Appended in order
+
+        // Back-dated events invalidate the checkpoints past where they land
+        size_t landed = upper_bound(events.begin(), middle, *middle, byTime) - events.begin();
+        inplace_merge(events.begin(), middle, events.end(), byTime);
+        if (checkpoints.size() > landed / interval + 1) checkpoints.resize(landed / interval + 1);
+    }
+
+    // Number of events at or before time
+    size_t position(Timestamp time) const {
+        return upper_bound(events.begin(), events.end(), time,
+                           [](Timestamp t, const Event &e) { return t < e.time; }) - events.begin();
+    }
+
+    // Balances after the first `count` events
+    void balancesAt(size_t count, const ExpenseStore &expenses, const vector<Settlement> &settled,
+                    size_t userCount, vector<Money> &out) {
+        size_t c = count / interval;
+        if (checkpoints.empty()) checkpoints.emplace_back();
+        while (checkpoints.size() <= c) {
+            vector<Money> next = checkpoints.back();
+            next.resize(userCount, 0);
+            size_t begin = (checkpoints.size() - 1) * interval;
+            replay(begin, begin + interval, expenses, settled, next);
+            checkpoints.push_back(move(next));
+        }
+        out = checkpoints[c];
+        out.resize(userCount, 0);
+        replay(c * interval, count, expenses, settled, out);
+    }
+
+    // Adds the balance changes of events [begin, end) to balances
+    void replay(size_t begin, size_t end, const ExpenseStore &expenses, const vector<Settlement> &settled,
+                vector<Money> &balances) const {
+        for (size_t i = begin; i < end; ++i) {
+            size_t index = events[i].index();
+            if (events[i].isSettlement()) {
+                balances[settled[index].fromUser] += settled[index].amount;
+                balances[settled[index].toUser] -= settled[index].amount;
+                continue;
+            }
+            UserId payer = expenses.payers[index];
+            for (uint64_t slot = expenses.participantOffsets[index] + 1; slot < expenses.participantOffsets[index + 1]; ++slot) {
+                balances[payer] += expenses.shares[slot];
+                balances[expenses.participants[slot]] -= expenses.shares[slot];
+            }
+        }
+    }
+};
+
+// Forest of rooted trees over users with a cost on each node's edge to its
+// parent, kept as a link-cut tree (Sleator and Tarjan): each preferred path
+// is a splay tree ordered from root to leaf, and after access(x) the splay
+// tree rooted at x holds exactly the path from x up to its tree root. Path
+// minimum, path add and finding the minimum cost edge then cost amortized
+// O(log n). Roots carry cost NONE, which no path update brings near zero.
+struct LinkCutForest {
+    static constexpr uint32_t NIL = UINT32_MAX;
+    static constexpr Money NONE = INT64_MAX / 2;
+
+    struct Node {
+        uint32_t parent = NIL;                     // Splay parent, or path parent for a splay root
+        uint32_t left = NIL, right = NIL;
+        uint32_t size = 1;                         // Nodes in the splay subtree
+        Money cost = NONE;                         // Cost of the edge to the tree parent
+        Money minCost = NONE;                      // Minimum cost in the splay subtree
+        Money pending = 0;                         // Lazy add for the splay subtree
+        uint32_t edge = NIL;                       // Caller's id for the edge to the tree parent
+    };
+    vector<Node> nodes;
+
+    explicit LinkCutForest(size_t n) : nodes(n) {}
+
+    bool isSplayRoot(uint32_t x) const {
+        uint32_t p = nodes[x].parent;
+        return p == NIL || (nodes[p].left != x && nodes[p].right != x);
+    }
+
+    void add(uint32_t x, Money delta) {
+        nodes[x].cost += delta;
+        nodes[x].minCost += delta;
+        nodes[x].pending += delta;
+    }
+
+    void push(uint32_t x) {
+        Node &n = nodes[x];
+        if (n.pending == 0) return;
+        if (n.left != NIL) add(n.left, n.pending);
+        if (n.right != NIL) add(n.right, n.pending);
+        n.pending = 0;
+    }
+
+    void pull(uint32_t x) {
+        Node &n = nodes[x];
+        n.size = 1;
+        n.minCost = n.cost;
+        for (uint32_t child : {n.left, n.right}) {
+            if (child == NIL) continue;
+            n.size += nodes[child].size;
+            n.minCost = min(n.minCost, nodes[child].minCost);
+        }
+    }
+
+    void rotate(uint32_t x) {
+        Node &n = nodes[x];
+        uint32_t p = n.parent, g = nodes[p].parent;
+        if (!isSplayRoot(p)) (nodes[g].left == p ? nodes[g].left : nodes[g].right) = x;
+        n.parent = g;
+        if (nodes[p].left == x) {
+            nodes[p].left = n.right;
+            if (n.right != NIL) nodes[n.right].parent = p;
+            n.right = p;
+        } else {
+            nodes[p].right = n.left;
+            if (n.left != NIL) nodes[n.left].parent = p;
+            n.left = p;
+        }
+        nodes[p].parent = x;
+        pull(p);
+        pull(x);
+    }
+
+    void splay(uint32_t x) {
+        // Apply pending adds from the top of x's splay tree down
+        static thread_local vector<uint32_t> path;
+        path.clear();
+        for (uint32_t y = x; ; y = nodes[y].parent) {
+            path.push_back(y);
+            if (isSplayRoot(y)) break;
+        }
+        for (size_t i = path.size(); i-- > 0; ) push(path[i]);
+
+        while (!isSplayRoot(x)) {
+            uint32_t p = nodes[x].parent;
+            if (!isSplayRoot(p)) rotate((nodes[nodes[p].parent].left == p) == (nodes[p].left == x) ? p : x);
+            rotate(x);
+        }
+    }
+
+    // Afterwards x is the root of a splay tree holding exactly the path
+    // from x up to its tree root
+    void access(uint32_t x) {
+        for (uint32_t y = x, last = NIL; y != NIL; last = y, y = nodes[y].parent) {
+            splay(y);
+            nodes[y].right = last;
+            pull(y);
+        }
+        splay(x);
+    }
+
+    uint32_t findRoot(uint32_t x) {
+        access(x);
+        while (nodes[x].left != NIL) {
+            push(x);
+            x = nodes[x].left;
+        }
+        splay(x);
+        return x;
+    }
+
+    // Makes tree root x a child of y
+    void link(uint32_t x, uint32_t y, Money edgeCost, uint32_t edgeId) {
+        access(x);
+        nodes[x].cost = edgeCost;
+        nodes[x].edge = edgeId;
+        pull(x);
+        nodes[x].parent = y;
+    }
+
+    // Detaches x from its tree parent and returns the edge's cost
+    Money cut(uint32_t x) {
+        access(x);
+        Node &n = nodes[x];
+        Money edgeCost = n.cost;
+        if (n.left != NIL) {
+            nodes[n.left].parent = NIL;
+            n.left = NIL;
+        }
+        n.cost = NONE;
+        n.edge = NIL;
+        pull(x);
+        return edgeCost;
+    }
+
+    // A node on the path from x up to its root whose edge has the minimum cost
+    uint32_t pathArgMin(uint32_t x) {
+        access(x);
+        Money target = nodes[x].minCost;
+        while (true) {
+            push(x);
+            const Node &n = nodes[x];
+            if (n.cost == target) break;
+            x = n.left != NIL && nodes[n.left].minCost == target ? n.left : n.right;
+        }
+        splay(x);
+        return x;
+    }
+};
+
+// Bounded multi-producer, single-consumer ring of settlements. Each cell
+// carries a sequence number: producers claim a position with one CAS on
+// the enqueue counter and publish the cell by advancing its sequence, so
+// concurrent submitters never take a lock. The single consumer drains
+// published cells in order without any atomic read-modify-write.
+class SettlementRing {
+public:
+    explicit SettlementRing(size_t capacity) : cells(new Cell[capacity]), mask(capacity - 1) {
+        // capacity must be a power of two
+        for (size_t i = 0; i < capacity; ++i) cells[i].sequence.store(i, memory_order_relaxed);
+    }
+
+    // Returns false when the ring is full; otherwise position is where s
+    // went, counting every settlement ever pushed
+    bool tryPush(const Settlement &s, size_t &position) {
+        size_t pos = enqueuePos.load(memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(memory_order_relaxed);
+            }
+        }
+        cell->value = s;
+        cell->sequence.store(pos + 1, memory_order_release);
+        position = pos;
+        return true;
+    }
+
+    // Consumer only: moves up to max published settlements into out
+    size_t popBatch(Settlement *out, size_t max) {
+        size_t pos = dequeuePos.load(memory_order_relaxed);
+        size_t n = 0;
+        while (n < max) {
+            Cell &cell = cells[pos & mask];
+            if (cell.sequence.load(memory_order_acquire) != pos + 1) break;
+            out[n++] = cell.value;
+            cell.sequence.store(pos + mask + 1, memory_order_release);
+            ++pos;
+        }
+        dequeuePos.store(pos, memory_order_relaxed);
+        return n;
+    }
+
+    // Consumer only: every position below this one has been popped
+    size_t popped() const { return dequeuePos.load(memory_order_relaxed); }
+
+    // Approximate number of queued settlements
+    size_t size() const {
+        return enqueuePos.load(memory_order_relaxed) - dequeuePos.load(memory_order_relaxed);
+    }
+
+private:
+    struct Cell {
+        atomic<size_t> sequence;
+        Settlement value;
+    };
+
+    unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) atomic<size_t> enqueuePos{0};
+    alignas(64) atomic<size_t> dequeuePos{0};
+};
+
+enum class ReportFormat { Table, Csv, Json };
+
+// Builds report text in one reusable buffer and writes it to stdout in
+// large chunks, skipping iostream formatting. Amounts go through a
+// dedicated fixed-2 formatter. Anything already sent to cout is flushed
+// first so the two never interleave.
+class ReportWriter {
+public:
+    static constexpr size_t CAPACITY = 1 << 20;
+    static constexpr size_t ESCAPE_CHUNK = 4096;       // Escaped text is staged at most this much at a time
+
+    void begin() {
+        cout.flush();
+        fflush(stdout);
+        if (!data) data.reset(new char[CAPACITY]);
+        used = 0;
+    }
+
+    ReportWriter &text(string_view value) {
+        if (value.size() > CAPACITY - used) {
+            flush();
+            if (value.size() > CAPACITY) {
+                writeAll(value.data(), value.size());
+                return *this;
+            }
+        }
+        memcpy(data.get() + used, value.data(), value.size());
+        used += value.size();
+        return *this;
+    }
+
+    ReportWriter &money(Money amount) {
+        char *p = reserve(24) + 24, *end = p;
+        uint64_t magnitude = amount < 0 ? 0 - static_cast<uint64_t>(amount) : amount;
+        *--p = static_cast<char>('0' + magnitude % 10);
+        *--p = static_cast<char>('0' + magnitude / 10 % 10);
+        *--p = '.';
+        magnitude /= 100;
+        do *--p = static_cast<char>('0' + magnitude % 10); while (magnitude /= 10);
+        if (amount < 0) *--p = '-';
+        size_t length = end - p;
+        memmove(data.get() + used, p, length);
+        used += length;
+        return *this;
+    }
+
+    // ISO 8601 in UTC, e.g. 2024-03-01T18:30:00Z
+    ReportWriter &timestamp(Timestamp value) {
+        time_t seconds = static_cast<time_t>(value);
+        struct tm parts;
+        char *out = reserve(32);
+        size_t length = gmtime_r(&seconds, &parts) ? strftime(out, 32, "%Y-%m-%dT%H:%M:%SZ", &parts) : 0;
+        used += length;
+        return *this;
+    }
+
+    // A CSV field, quoted only when it contains a delimiter, quote or newline
+    ReportWriter &csv(string_view value) {
+        if (value.find_first_of(",\"\r\n") == string_view::npos) return text(value);
+        text("\"");
+        for (size_t at = 0; at < value.size(); at += ESCAPE_CHUNK) {
+            string_view part = value.substr(at, ESCAPE_CHUNK);
+            char *out = reserve(2 * part.size()), *start = out;
+            for (char c : part) {
+                if (c == '"') *out++ = '"';
+                *out++ = c;
+            }
+            used += out - start;
+        }
+        return text("\"");
+    }
+
+    // A JSON string literal
+    ReportWriter &json(string_view value) {
+        static const char hex[] = "0123456789abcdef";
+        text("\"");
+        for (size_t at = 0; at < value.size(); at += ESCAPE_CHUNK) {
+            string_view part = value.substr(at, ESCAPE_CHUNK);
+            char *out = reserve(6 * part.size()), *start = out;
+            for (char c : part) {
+                unsigned char u = static_cast<unsigned char>(c);
+                if (c == '"' || c == '\\') {
+                    *out++ = '\\';
+                    *out++ = c;
+                } else if (u < 0x20) {
+                    memcpy(out, "\\u00", 4);
+                    out[4] = hex[u >> 4];
+                    out[5] = hex[u & 15];
+                    out += 6;
+                } else {
+                    *out++ = c;
+                }
+            }
+            used += out - start;
+        }
+        return text("\"");
+    }
+
+    void flush() {
+        writeAll(data.get(), used);
+        used = 0;
+    }
+
+private:
+    unique_ptr<char[]> data;
+    size_t used = 0;
+
+    // Makes room for size bytes and returns where they start
+    char *reserve(size_t size) {
+        if (size > CAPACITY - used) flush();
+        return data.get() + used;
+    }
+
+    static void writeAll(const char *bytes, size_t size) {
+        size_t written = 0;
+        while (written < size) {
+            ssize_t n = write(STDOUT_FILENO, bytes + written, size - written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            written += static_cast<size_t>(n);
+        }
+    }
+};
+
+// Operations timed by the instrumentation (see Operation Stats)
+enum class Operation { AddExpense, ProcessSettlement, ApplySettlements, UpdateExpense,
+                       PrintExpenses, PrintBalances, PrintGraph, ServeRequest, Count };
+const char *const OPERATION_NAMES[] = {"addExpense", "processSettlement", "applySettlements",
+                                       "updateExpenseAfterSettlement", "printExpenses", "printBalances",
+                                       "printGraph", "serveRequest"};
+const size_t OPERATION_COUNT = static_cast<size_t>(Operation::Count);
+
+// Log-linear latency histogram in the style of HdrHistogram: values below
+// 2 * SUB_BUCKETS are counted exactly, larger ones in SUB_BUCKETS buckets
+// per power of two, so any recorded value is known to within 1/16. Each
+// histogram has a single writer (its thread); counters are relaxed atomics
+// updated with a plain load and store, so recording costs no locked
+// instruction and a reader on another thread still sees whole values.
+struct LatencyHistogram {
+    static constexpr unsigned SUB_BITS = 4;
+    static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr size_t BUCKETS = SUB_BUCKETS * (65 - SUB_BITS);
+
+    atomic<uint64_t> counts[BUCKETS] = {};
+    atomic<uint64_t> total{0};
+    atomic<uint64_t> sum{0};
+    atomic<uint64_t> max{0};
+
+    static size_t bucket(uint64_t value) {
+        if (value < 2 * SUB_BUCKETS) return value;
+        unsigned shift = 63 - __builtin_clzll(value) - SUB_BITS;
+        return SUB_BUCKETS * shift + (value >> shift);
+    }
+
+    // Smallest value counted in bucket i
+    static uint64_t lowest(size_t i) {
+        if (i < 2 * SUB_BUCKETS) return i;
+        unsigned shift = static_cast<unsigned>(i / SUB_BUCKETS - 1);
+        return (i - SUB_BUCKETS * shift) << shift;
+    }
+
+    static void bump(atomic<uint64_t> &counter, uint64_t by) {
+        counter.store(counter.load(memory_order_relaxed) + by, memory_order_relaxed);
+    }
+
+    void record(uint64_t value) {
+        bump(counts[bucket(value)], 1);
+        bump(total, 1);
+        bump(sum, value);
+        if (value > max.load(memory_order_relaxed)) max.store(value, memory_order_relaxed);
+    }
+};
+
+// One thread's histograms, one per operation
+struct OperationStats {
+    LatencyHistogram histograms[OPERATION_COUNT];
+};
+
+// Ledger core: the bookkeeping behind every expense and settlement (the
+// balances, the debt graph and each user's expense slots), written once as a
+// template over the amount type, the user key type and two container
+// policies. The policies are mixed in as bases, so their members are
+// members of the core and every call below is bound at compile time, with
+// no virtual dispatch. User keys are dense interned ids (the per-user slot
+// lists are indexed by them); amounts need only +, - and a zero value.
+//
+// A balance policy provides addUserBalance(user), changeBalance(user,
+// change) and balanceOf(user); a graph policy provides addDebt(from, to,
+// amount), edgeCount() and forEachEdge(f). Ledger uses RankedBalances and
+// IndexedDebtGraph; PriceTracker-bench.cpp times the other combinations.
+
+// Balances in a copy-on-write column (see LedgerView), with the creditor
+// and debtor rankings kept in step
+template <typename Amount, typename UserKey>
+struct RankedBalances {
+    static_assert(is_same<Amount, Money>::value, "BalanceHeap ranks Money amounts");
+
+    CowColumn<Amount> userBalances;                // User balances, indexed by user
+    BalanceHeap creditorHeap{1};                   // Users ranked by amount owed to them
+    BalanceHeap debtorHeap{-1};                    // Users ranked by amount they owe
+
+    void addUserBalance(UserKey user) {
+        userBalances.resize(user + 1, 0);
+        creditorHeap.add(user, 0);
+        debtorHeap.add(user, 0);
+    }
+
+    void changeBalance(UserKey user, Amount change) {
+        Amount &balance = userBalances.edit(user);
+        balance += change;
+        creditorHeap.update(user, balance);
+        debtorHeap.update(user, balance);
+    }
+
+    Amount balanceOf(UserKey user) const { return userBalances[user]; }
+};
+
+// Plain balance array, no rankings
+template <typename Amount, typename UserKey>
+struct DenseBalances {
+    vector<Amount> userBalances;
+
+    void addUserBalance(UserKey user) { userBalances.resize(user + 1, Amount()); }
+    void changeBalance(UserKey user, Amount change) { userBalances[user] += change; }
+    Amount balanceOf(UserKey user) const { return userBalances[user]; }
+};
+
+// Balances in an ordered map, as the tracker first kept them
+template <typename Amount, typename UserKey>
+struct OrderedBalances {
+    map<UserKey, Amount> userBalances;
+
+    void addUserBalance(UserKey user) { userBalances.emplace(user, Amount()); }
+    void changeBalance(UserKey user, Amount change) { userBalances[user] += change; }
+    Amount balanceOf(UserKey user) const { return userBalances.at(user); }
+};
+
+// One edge per user pair in a copy-on-write column, found through an
+// open-addressing index on the pair
+template <typename Amount, typename UserKey>
+struct IndexedDebtGraph {
+    static_assert(sizeof(UserKey) <= sizeof(UserId), "EdgeIndex packs two 32-bit keys");
+
+    CowColumn<BasicGraphEdge<Amount, UserKey>> debtGraph; // Graph for user debts, one edge per user pair
+    EdgeIndex debtEdgeIndex;                       // (fromUser, toUser) -> position in debtGraph
+
+    void addDebt(UserKey fromUser, UserKey toUser, Amount amount) {
+        uint64_t key = EdgeIndex::key(fromUser, toUser);
+        uint32_t position;
+        if (debtEdgeIndex.find(key, position)) {
+            debtGraph.edit(position).amount += amount;
+            return;
+        }
+
+        debtEdgeIndex.insert(key, static_cast<uint32_t>(debtGraph.size()));
+        debtGraph.push_back({fromUser, toUser, amount});
+    }
+
+    size_t edgeCount() const { return debtGraph.size(); }
+
+    template <typename F>
+    void forEachEdge(F f) const {
+        for (size_t i = 0; i < debtGraph.size(); ++i) f(debtGraph[i]);
+    }
+};
+
+// Edge amounts in a hash map keyed by the packed user pair
+template <typename Amount, typename UserKey>
+struct HashedDebtGraph {
+    static_assert(sizeof(UserKey) <= sizeof(UserId), "Edge keys pack two 32-bit keys");
+
+    unordered_map<uint64_t, Amount> debtGraph;
+
+    void addDebt(UserKey fromUser, UserKey toUser, Amount amount) {
+        debtGraph[EdgeIndex::key(fromUser, toUser)] += amount;
+    }
+
+    size_t edgeCount() const { return debtGraph.size(); }
+
+    template <typename F>
+    void forEachEdge(F f) const {
+        for (const auto &entry : debtGraph) {
+            f(BasicGraphEdge<Amount, UserKey>{static_cast<UserKey>(entry.first >> 32),
+                                              static_cast<UserKey>(entry.first), entry.second});
+        }
+    }
+};
+
+// Edge amounts in an ordered map keyed by the user pair
+template <typename Amount, typename UserKey>
+struct OrderedDebtGraph {
+    map<pair<UserKey, UserKey>, Amount> debtGraph;
+
+    void addDebt(UserKey fromUser, UserKey toUser, Amount amount) { debtGraph[{fromUser, toUser}] += amount; }
+
+    size_t edgeCount() const { return debtGraph.size(); }
+
+    template <typename F>
+    void forEachEdge(F f) const {
+        for (const auto &entry : debtGraph)
+            f(BasicGraphEdge<Amount, UserKey>{entry.first.first, entry.first.second, entry.second});
+    }
+};
+
+// The owed amounts live with the expense rows, so settlement calls take
+// that column (anything with edit(slot)) rather than the core owning it
+template <typename Amount, typename UserKey,
+          template <typename, typename> class BalancePolicy,
+          template <typename, typename> class GraphPolicy>
+struct LedgerCore : BalancePolicy<Amount, UserKey>, GraphPolicy<Amount, UserKey> {
+    vector<vector<uint64_t>> userSlots;            // Participant arena slots of each user, indexed by user
+
+    // Users are added in key order, each exactly once
+    void addUser(UserKey user) {
+        userSlots.resize(user + 1);
+        this->addUserBalance(user);
+    }
+
+    // Participant 0 is the payer, who owes nothing and is credited exactly
+    // what the others owe; the participants occupy slots firstSlot onwards
+    void addExpense(UserKey paidBy, const UserKey *participants, const Amount *owed, size_t count,
+                    uint64_t firstSlot) {
+        for (size_t i = 0; i < count; ++i) userSlots[participants[i]].push_back(firstSlot + i);
+
+        Amount credited = Amount();
+        for (size_t i = 1; i < count; ++i) {
+            credited += owed[i];
+            this->changeBalance(participants[i], -owed[i]);
+            this->addDebt(paidBy, participants[i], owed[i]);
+        }
+        this->changeBalance(paidBy, credited);
+    }
+
+    template <typename Owed>
+    void applySettlement(UserKey fromUser, UserKey toUser, Amount amount, Owed &owed) {
+        this->changeBalance(fromUser, amount);
+        this->changeBalance(toUser, -amount);
+        updateExpenseAfterSettlement(fromUser, toUser, amount, owed);
+    }
+
+    // Only the rows the two users appear in are touched
+    template <typename Owed>
+    void updateExpenseAfterSettlement(UserKey fromUser, UserKey toUser, Amount amount, Owed &owed) {
+        for (uint64_t slot : userSlots[fromUser]) owed.edit(slot) -= amount;
+        for (uint64_t slot : userSlots[toUser]) owed.edit(slot) += amount;
+    }
+
+    // One user's net change over a batch of settlements
+    template <typename Owed>
+    void applyNetChange(UserKey user, Amount change, Owed &owed) {
+        this->changeBalance(user, change);
+        for (uint64_t slot : userSlots[user]) owed.edit(slot) -= change;
+    }
+};
+
+using LedgerBooks = LedgerCore<Money, UserId, RankedBalances, IndexedDebtGraph>;
+
+// One group's books. Every group (tenant) gets its own Ledger; the
+// functions below work on the ledger the calling thread has selected, so
+// independent groups share neither state nor a lock.
+struct Ledger : LedgerBooks {
+    string name;
+    UserTable users;                               // Interned user names
+    ExpenseStore expenses;                         // List of expenses
+    queue<Settlement> settlements;                 // Queue for settlements
+    vector<Settlement> settledLog;                 // Settlements already applied, in order
+    vector<vector<uint64_t>> paidRows;             // Expense rows each user paid, indexed by UserId
+    shared_ptr<const vector<UserId>> nameOrder =   // User ids sorted by name, see usersByName()
+        make_shared<const vector<UserId>>();
+    ExpenseHistory history;                        // Time index, see Expense History
+    mutex lock;                                    // Held by whoever is reading or changing the ledger
+
+    // Persistence (see Persistence: Journal and Snapshots)
+    string dataPrefix;                             // Empty when persistence is off
+    FILE *journalFile = nullptr;                   // Open only while recording new changes
+    uint64_t journalSequence = 0;                  // Last record written or replayed
+    uint64_t recordsSinceSnapshot = 0;
+    bool batchingJournal = false;                  // Set by ingestFile, see writeJournalRecord
+    vector<char> journalBatch;                     // Records not yet handed to journalFile
+    once_flag opened;
+    bool openFailed = false;
+};
+
+// Consistent, immutable view of what the reports read, taken under the
+// ledger lock by viewLedger() in time proportional to the number of column
+// chunks. The members are named as in Ledger, so report code can be written
+// once for both. Writers carry on while a report runs on a view.
+struct LedgerView {
+    UserTable::View users;
+    ExpenseStore::View expenses;
+    CowColumn<Money>::View userBalances;
+    CowColumn<GraphEdge>::View debtGraph;
+    shared_ptr<const vector<UserId>> nameOrder;
+};
+
+// Hosts the ledgers by group name. Lookups share a reader lock on the map;
+// creating a group takes it exclusively. Work on a ledger only ever takes
+// that ledger's own lock.
+class LedgerRegistry {
+public:
+    Ledger &get(const string &name) {
+        {
+            shared_lock<shared_mutex> readLock(mapMutex);
+            auto it = ledgers.find(name);
+            if (it != ledgers.end()) return *it->second;
+        }
+        unique_lock<shared_mutex> writeLock(mapMutex);
+        unique_ptr<Ledger> &slot = ledgers[name];
+        if (!slot) {
+            slot.reset(new Ledger);
+            slot->name = name;
+            order.push_back(slot.get());
+        }
+        return *slot;
+    }
+
+    // All ledgers in creation order
+    vector<Ledger *> all() {
+        shared_lock<shared_mutex> readLock(mapMutex);
+        return order;
+    }
+
+private:
+    shared_mutex mapMutex;
+    unordered_map<string, unique_ptr<Ledger>> ledgers;
+    vector<Ledger *> order;
+};
+
+// Fixed set of worker threads running submitted tasks in FIFO order
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount) {
+        for (size_t i = 0; i < max<size_t>(1, threadCount); ++i) workers.emplace_back([this]() { run(); });
+    }
+
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> guard(queueMutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto &worker : workers) worker.join();
+    }
+
+    void submit(function<void()> task) {
+        {
+            lock_guard<mutex> guard(queueMutex);
+            tasks.push(move(task));
+            pending++;
+        }
+        ready.notify_one();
+    }
+
+    // Blocks until every submitted task has finished
+    void wait() {
+        unique_lock<mutex> guard(queueMutex);
+        idle.wait(guard, [this]() { return pending == 0; });
+    }
+
+    size_t size() const { return workers.size(); }
+
+private:
+    vector<thread> workers;
+    queue<function<void()>> tasks;
+    mutex queueMutex;
+    condition_variable ready, idle;
+    size_t pending = 0;                            // Queued or running
+    bool stopping = false;
+
+    void run() {
+        while (true) {
+            function<void()> task;
+            {
+                unique_lock<mutex> guard(queueMutex);
+                ready.wait(guard, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty()) return;
+                task = move(tasks.front());
+                tasks.pop();
+            }
+            task();
+            {
+                lock_guard<mutex> guard(queueMutex);
+                if (--pending == 0) idle.notify_all();
+            }
+        }
+    }
+};
+
+// ------------------------------
+// Global Data Structures
+// ------------------------------
+const char *const DEFAULT_GROUP = "default";
+LedgerRegistry ledgers;                            // Every group's ledger, by name
+thread_local Ledger *ledger = nullptr;             // Ledger the calling thread is working on
+thread_local ReportWriter report;                  // Output buffer shared by the reports
+ReportFormat reportFormat = ReportFormat::Table;    // Format of the expense, graph and balance reports
+string dataRoot;                                   // --data prefix; empty when persistence is off
+
+// Selects a ledger for the calling thread until the end of the scope
+struct LedgerScope {
+    Ledger *previous;
+    explicit LedgerScope(Ledger &selected) : previous(ledger) { ledger = &selected; }
+    ~LedgerScope() { ledger = previous; }
+};
+
+// Operation stats. Each thread records into its own OperationStats, created
+// on first use and kept for the life of the process so that a report still
+// counts threads that have finished.
+atomic<bool> statsEnabled{false};
+mutex statsLock;                                   // Guards allStats
+vector<unique_ptr<OperationStats>> allStats;
+thread_local OperationStats *threadStats = nullptr;
+
+// Cheap monotonic clock: the TSC on x86-64 (converted to nanoseconds when
+// reported), steady_clock nanoseconds elsewhere
+inline uint64_t statsTicks() {
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+const uint64_t statsTicksOrigin = statsTicks();
+const chrono::steady_clock::time_point statsClockOrigin = chrono::steady_clock::now();
+
+OperationStats &registerThreadStats() {
+    lock_guard<mutex> lock(statsLock);
+    allStats.emplace_back(new OperationStats);
+    threadStats = allStats.back().get();
+    return *threadStats;
+}
+
+// Times the enclosing scope as one operation when stats are enabled
+struct OperationTimer {
+    Operation operation;
+    uint64_t start;
+    explicit OperationTimer(Operation operation)
+        : operation(operation), start(statsEnabled.load(memory_order_relaxed) ? statsTicks() : 0) {}
+    ~OperationTimer() {
+        if (start == 0) return;
+        uint64_t elapsed = statsTicks() - start;
+        OperationStats &stats = threadStats ? *threadStats : registerThreadStats();
+        stats.histograms[static_cast<size_t>(operation)].record(elapsed);
+    }
+};
+
+// Background settlement processing
+SettlementRing settlementRing(1 << 16);            // Settlements submitted to the worker
+Ledger *settlementWorkerLedger = nullptr;          // Ledger the worker applies settlements to
+thread settlementWorker;
+atomic<bool> settlementWorkerRunning{false};
+atomic<uint64_t> settlementsProcessed{0};          // Applied by the worker since it started
+atomic<uint64_t> settlementBatches{0};
+atomic<uint64_t> settlementsJournaled{0};          // Ring positions below this are applied and journaled
+int settlementJournaledPipe[2] = {-1, -1};         // Written by the worker after each batch, see serve
+chrono::steady_clock::time_point settlementWorkerStart;
+
+// ------------------------------
+// Function Prototypes
+// ------------------------------
+void addExpense();
+void recordExpense(string_view description, Money amount, UserId paidBy, const vector<UserId> &debtors,
+                   Timestamp time);
+void appendExpense(string_view description, Money amount, UserId paidBy, Timestamp time,
+                   const UserId *participants, const Money *owed, size_t count);
+void addItemizedExpense();
+bool parseSplitKind(string_view name, SplitKind &kind);
+bool parseSplitValue(SplitKind kind, string_view text, double &weight, Money &exact);
+bool computeSplit(Money amount, UserId paidBy, const SplitSpec &spec, vector<UserId> &participants,
+                  vector<Money> &owed, string &error);
+bool recordSplitExpense(string_view description, Money amount, UserId paidBy, const SplitSpec &spec,
+                        Timestamp time, string &error);
+void printExpenses();
+template <typename Source>
+void writeExpense(const Source &source, size_t row, bool first, bool withTime);
+void printUserExpenses(UserId user, bool paidOnly);
+void showUserExpenses(bool paidOnly);
+void enqueueSettlement();
+void processSettlement();
+void applySettlement(const Settlement &s);
+void applySettlements(const Settlement *batch, size_t count);
+void processAllSettlements();
+uint64_t submitSettlement(const Settlement &s);
+void startSettlementWorker();
+void stopSettlementWorker();
+void printSettlementThroughput();
+void printBalances();
+template <typename Balances>
+void printBalances(const LedgerView &view, const Balances &userBalances, string_view title);
+bool parseReportFormat(string_view name, ReportFormat &format);
+void chooseReportFormat();
+void printTopBalances(size_t count);
+void printSettlements();
+void printGraph();
+void updateExpenseAfterSettlement(UserId fromUser, UserId toUser, Money amount);
+vector<Settlement> simplifyDebts();
+void printSimplifiedDebts();
+CycleStats cancelDebtCycles();
+void printCycleStats(const CycleStats &stats);
+bool auditBalances();
+void printOperationStats();
+bool parseTimestamp(string_view text, Timestamp &time, bool endOfDay);
+void printExpenseHistory(Timestamp from, Timestamp to);
+void printBalancesAsOf(Timestamp time);
+void showExpenseHistory();
+void showBalancesAsOf();
+bool recordExpenseFields(const vector<string_view> &fields, Timestamp time, string &error);
+bool parseSettlementFields(const vector<string_view> &fields, Timestamp time, Settlement &s);
+bool ingestFile(const char *path, IngestStats &stats);
+void printIngestSummary(const char *path, const IngestStats &stats);
+bool openDataStore(const string &prefix);
+Ledger *openGroup(const string &name);
+bool validGroupName(string_view name);
+void switchGroup();
+void serveRequest(string_view line, Ledger *&group, string &out, bool &quit, vector<Settlement> &submitted);
+void blockStopSignals();
+bool serve(const char *path);
+void journalUser(UserId user);
+void journalExpense(size_t row);
+void journalSettlement(const Settlement &s);
+void journalSettlements(const Settlement *batch, size_t count);
+void journalCycleCancellation();
+void flushJournal();
+bool writeSnapshot();
+bool writeAllSnapshots();
+
+// ------------------------------
+// Helper: Read line input
+// ------------------------------
+string readString(const string &prompt) {
+    cout << prompt;
+    string input;
+    getline(cin, input);
+    return input;
+}
+
+// ------------------------------
+// Money: parsing, formatting and splitting
+// ------------------------------
+// Parses a plain decimal such as "-12.5" into cents, rounding half away
+// from zero past the second decimal place
+bool parseMoney(string_view text, Money &amount) {
+    size_t i = 0;
+    bool negative = !text.empty() && text[0] == '-';
+    if (negative) i++;
+
+    Money cents = 0;
+    size_t wholeDigits = 0, fractionDigits = 0;
+    bool roundUp = false;
+    for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i, ++wholeDigits) {
+        if (wholeDigits == 16) return false; // Would overflow once scaled to cents
+        cents = cents * 10 + (text[i] - '0');
+    }
+    cents *= 100;
+    if (i < text.size() && text[i] == '.') {
+        for (++i; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i, ++fractionDigits) {
+            if (fractionDigits == 0) cents += (text[i] - '0') * 10;
+            else if (fractionDigits == 1) cents += text[i] - '0';
+            else if (fractionDigits == 2) roundUp = text[i] >= '5';
+        }
+    }
+    if (wholeDigits + fractionDigits == 0 || i != text.size()) return false;
+
+    if (roundUp) cents++;
+    amount = negative ? -cents : cents;
+    return true;
+}
+
+string formatMoney(Money amount) {
+    uint64_t magnitude = amount < 0 ? 0 - static_cast<uint64_t>(amount) : amount;
+    char cents[3] = {static_cast<char>('0' + magnitude % 100 / 10), static_cast<char>('0' + magnitude % 10), 0};
+    return (amount < 0 ? "-" : "") + to_string(magnitude / 100) + "." + cents;
+}
+
+// ISO 8601 in UTC, as ReportWriter::timestamp writes it
+string formatTimestamp(Timestamp time) {
+    time_t seconds = static_cast<time_t>(time);
+    struct tm parts;
+    char text[32];
+    size_t length = gmtime_r(&seconds, &parts) ? strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", &parts) : 0;
+    return string(text, length);
+}
+
+Money readMoney(const string &prompt) {
+    Money amount;
+    while (!parseMoney(readString(prompt), amount)) {
+        cout << "Invalid amount. ";
+    }
+    return amount;
+}
+
+// Splits amount into parts equal shares that add up exactly; the leftover
+// cents go one each to the first shares
+void splitEvenly(Money amount, size_t parts, vector<Money> &shares) {
+    Money share = amount / static_cast<Money>(parts);
+    Money remainder = amount % static_cast<Money>(parts);
+    shares.assign(parts, share);
+    for (size_t i = 0; remainder != 0; ++i) {
+        shares[i] += remainder > 0 ? 1 : -1;
+        remainder += remainder > 0 ? -1 : 1;
+    }
+}
+
+// Splits amount in proportion to count non-negative weights (with a positive,
+// finite total) into shares that add up exactly. One straight-line pass over
+// the weight array scales and truncates every share, with no branches for the
+// compiler to vectorise around; the cents lost to truncation then go one each
+// to the largest remainders, ties to the earlier entry. Each weight is divided
+// by the total before scaling, so no share can exceed the amount.
+void splitByWeight(Money amount, const double *weights, size_t count, Money *shares) {
+    static thread_local vector<double> remainders;
+    static thread_local vector<uint32_t> order;
+    uint64_t magnitude = amount < 0 ? 0 - static_cast<uint64_t>(amount) : amount;
+
+    double total = 0;
+    for (size_t i = 0; i < count; ++i) total += weights[i];
+    double scale = static_cast<double>(magnitude);
+
+    remainders.resize(count);
+    double *remainder = remainders.data();
+    int64_t assigned = 0;
+    for (size_t i = 0; i < count; ++i) {
+        double exact = weights[i] / total * scale;
+        shares[i] = static_cast<Money>(exact);
+        remainder[i] = exact - static_cast<double>(shares[i]);
+        assigned += shares[i];
+    }
+
+    // Normally 0 <= leftover < count; rounding in the products can push the
+    // truncated total a few cents past the amount, and then cents come back
+    // off the smallest remainders instead
+    int64_t leftover = static_cast<int64_t>(magnitude) - assigned;
+    while (leftover != 0) {
+        bool up = leftover > 0;
+        order.clear();
+        for (size_t i = 0; i < count; ++i) {
+            if (up ? weights[i] > 0 : shares[i] > 0) order.push_back(static_cast<uint32_t>(i));
+        }
+        size_t take = min<uint64_t>(up ? leftover : -leftover, order.size());
+        nth_element(order.begin(), order.begin() + (take - 1), order.end(), [&](uint32_t a, uint32_t b) {
+            if (remainder[a] != remainder[b]) return up ? remainder[a] > remainder[b] : remainder[a] < remainder[b];
+            return a < b;
+        });
+        for (size_t j = 0; j < take; ++j) shares[order[j]] += up ? 1 : -1;
+        leftover += up ? -static_cast<int64_t>(take) : static_cast<int64_t>(take);
+    }
+
+    if (amount < 0) {
+        for (size_t i = 0; i < count; ++i) shares[i] = -shares[i];
+    }
+}
+
+// ------------------------------
+// Helper: Intern a user and size the per-user tables
+// ------------------------------
+UserId internUser(string_view name) {
+    UserId id = ledger->users.intern(name);
+    if (id >= ledger->userBalances.size()) {
+        ledger->addUser(id);
+        ledger->paidRows.resize(id + 1);
+        journalUser(id);
+    }
+    return id;
+}
+
+// ------------------------------
+// Helper: User ids ordered by name (for printing)
+// ------------------------------
+// Users are only ever added, so the order is kept between calls and only
+// ids interned since the last call are sorted and merged in.
+const vector<UserId> &usersByName() {
+    shared_ptr<const vector<UserId>> &current = ledger->nameOrder;
+    size_t sorted = current->size();
+    if (sorted == ledger->users.size()) return *current;
+
+    // Views may hold the current order, so the merged one is a new version
+    auto order = make_shared<vector<UserId>>(*current);
+    auto byName = [](UserId a, UserId b) { return ledger->users.name(a) < ledger->users.name(b); };
+    for (size_t id = sorted; id < ledger->users.size(); ++id) order->push_back(static_cast<UserId>(id));
+    sort(order->begin() + sorted, order->end(), byName);
+    inplace_merge(order->begin(), order->begin() + sorted, order->end(), byName);
+    current = move(order);
+    return *current;
+}
+
+// Takes a view of the current ledger; the caller holds its lock
+LedgerView viewLedger() {
+    usersByName();
+    return LedgerView{ledger->users.view(), ledger->expenses.view(), ledger->userBalances.view(),
+                      ledger->debtGraph.view(), ledger->nameOrder};
+}
+
+// Takes a view of the current ledger, holding its lock only for that
+LedgerView lockedLedgerView() {
+    lock_guard<mutex> lock(ledger->lock);
+    return viewLedger();
+}
+
+// ------------------------------
+// Add Expense
+// ------------------------------
+void addExpense() {
+    string description = readString("\nEnter expense description: ");
+
+    Money amount = readMoney("Enter total amount: ");
+
+    string payer = readString("Enter who paid (user): ");
+
+    int userCount;
+    cout << "How many users are splitting the expense? ";
+    cin >> userCount;
+    cin.ignore();
+
+    vector<string> names;
+    for (int i = 0; i < userCount; i++) {
+        names.push_back(readString("Enter user " + to_string(i + 1) + " name: "));
+    }
+
+    // The ledger is locked only once the input is complete
+    lock_guard<mutex> lock(ledger->lock);
+    UserId paidBy = internUser(payer);
+    vector<UserId> debtors;
+    for (const string &name : names) debtors.push_back(internUser(name));
+
+    recordExpense(description, amount, paidBy, debtors, time(nullptr));
+    cout << "Expense added successfully.\n";
+}
+
+// ------------------------------
+// Record Expense (shared by the menu and batch ingestion)
+// ------------------------------
+void recordExpense(string_view description, Money amount, UserId paidBy, const vector<UserId> &debtors,
+                   Timestamp time) {
+    static thread_local vector<UserId> participants;
+    static thread_local vector<Money> owed;
+
+    // The payer keeps share 0 of the split for themselves
+    splitEvenly(amount, debtors.size() + 1, owed);
+    owed[0] = 0; // Payer owes nothing
+
+    participants.assign(1, paidBy);
+    participants.insert(participants.end(), debtors.begin(), debtors.end());
+
+    appendExpense(description, amount, paidBy, time, participants.data(), owed.data(), participants.size());
+}
+
+// ------------------------------
+// Append Expense (split already computed; also used by journal replay)
+// ------------------------------
+void appendExpense(string_view description, Money amount, UserId paidBy, Timestamp time,
+                   const UserId *participants, const Money *owed, size_t count) {
+    OperationTimer timer(Operation::AddExpense);
+    size_t row = ledger->expenses.append(description, amount, paidBy, time, participants, owed, count);
+
+    ledger->addExpense(paidBy, participants, owed, count, ledger->expenses.participantOffsets[row]);
+    ledger->paidRows[paidBy].push_back(row);
+
+    journalExpense(row);
+}
+
+// ------------------------------
+// Itemized Expenses: weighted, share, percentage and exact splits
+// ------------------------------
+bool parseSplitKind(string_view name, SplitKind &kind) {
+    for (size_t i = 0; i < size(SPLIT_KIND_NAMES); ++i) {
+        if (name == SPLIT_KIND_NAMES[i]) {
+            kind = static_cast<SplitKind>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Parses one user's part of a split: a non-negative weight or percentage, a
+// whole number of shares, or an exact amount. Equal splits take no value.
+bool parseSplitValue(SplitKind kind, string_view text, double &weight, Money &exact) {
+    weight = 1;
+    exact = 0;
+    switch (kind) {
+        case SplitKind::Equal:
+            return text.empty();
+        case SplitKind::Exact:
+            return parseMoney(text, exact);
+        case SplitKind::Shares:
+            if (text.empty() || text.size() > 9 || text.find_first_not_of("0123456789") != string_view::npos)
+                return false;
+            weight = static_cast<double>(strtoul(string(text).c_str(), nullptr, 10));
+            return true;
+        default: {
+            string copy(text);
+            char *end = nullptr;
+            weight = strtod(copy.c_str(), &end);
+            return !copy.empty() && end == copy.c_str() + copy.size() && isfinite(weight) && weight >= 0;
+        }
+    }
+}
+
+// Works out what each user in spec owes the payer. participants starts with
+// the payer, owing nothing, followed by the other listed users in order; a
+// payer who is listed simply keeps their own share. Returns false, with the
+// reason in error, when the spec cannot describe amount.
+bool computeSplit(Money amount, UserId paidBy, const SplitSpec &spec, vector<UserId> &participants,
+                  vector<Money> &owed, string &error) {
+    static thread_local vector<Money> shares;
+    static thread_local vector<uint8_t> listed;
+    size_t count = spec.users.size();
+    if (count == 0) {
+        error = "no users to split between";
+        return false;
+    }
+
+    listed.assign(ledger->users.size(), 0);
+    for (UserId user : spec.users) {
+        if (listed[user]++) {
+            error = string(ledger->users.name(user)) + " is listed twice";
+            return false;
+        }
+    }
+
+    shares.resize(count);
+    if (spec.kind == SplitKind::Equal) {
+        splitEvenly(amount, count, shares);
+    } else if (spec.kind == SplitKind::Exact) {
+        Money total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (__builtin_add_overflow(total, spec.amounts[i], &total)) {
+                error = "exact amounts are too large";
+                return false;
+            }
+        }
+        if (total != amount) {
+            error = "exact amounts add up to " + formatMoney(total) + ", not " + formatMoney(amount);
+            return false;
+        }
+        copy(spec.amounts.begin(), spec.amounts.end(), shares.begin());
+    } else {
+        // Subnormal weights would lose all precision once divided by the total
+        const char *kindName = SPLIT_KIND_NAMES[static_cast<size_t>(spec.kind)];
+        double total = 0;
+        for (double weight : spec.weights) {
+            if (weight != 0 && !isnormal(weight)) {
+                error = string(kindName) + " must be 0 or at least 2.3e-308";
+                return false;
+            }
+            total += weight;
+        }
+        if (!isfinite(total)) {
+            error = string(kindName) + " add up to more than can be represented";
+            return false;
+        }
+        if (spec.kind == SplitKind::Percent && fabs(total - 100) > 1e-6) {
+            char text[32];
+            snprintf(text, sizeof(text), "%g", total);
+            error = "percentages add up to " + string(text) + ", not 100";
+            return false;
+        }
+        if (!(total > 0)) {
+            error = string(kindName) + " add up to 0";
+            return false;
+        }
+        splitByWeight(amount, spec.weights.data(), count, shares.data());
+    }
+
+    participants.assign(1, paidBy);
+    owed.assign(1, 0);
+    for (size_t i = 0; i < count; ++i) {
+        if (spec.users[i] == paidBy) continue;
+        participants.push_back(spec.users[i]);
+        owed.push_back(shares[i]);
+    }
+    return true;
+}
+
+bool recordSplitExpense(string_view description, Money amount, UserId paidBy, const SplitSpec &spec,
+                        Timestamp time, string &error) {
+    static thread_local vector<UserId> participants;
+    static thread_local vector<Money> owed;
+    if (!computeSplit(amount, paidBy, spec, participants, owed, error)) return false;
+    appendExpense(description, amount, paidBy, time, participants.data(), owed.data(), participants.size());
+    return true;
+}
+
+void addItemizedExpense() {
+    string description = readString("\nEnter expense description: ");
+
+    Money amount = readMoney("Enter total amount: ");
+
+    string payer = readString("Enter who paid (user): ");
+
+    SplitSpec spec;
+    while (!parseSplitKind(readString("Split how (equal, weights, shares, percent, exact)? "), spec.kind)) {
+        cout << "Unknown split. ";
+    }
+
+    int userCount;
+    cout << "How many users are splitting the expense (include the payer if they have a share)? ";
+    cin >> userCount;
+    cin.ignore();
+
+    const char *valuePrompts[] = {"", "Enter weight for ", "Enter shares for ", "Enter percentage for ",
+                                  "Enter amount for "};
+    vector<string> names;
+    for (int i = 0; i < userCount; i++) {
+        string name = readString("Enter user " + to_string(i + 1) + " name: ");
+        double weight;
+        Money exact;
+        if (spec.kind != SplitKind::Equal) {
+            string prompt = valuePrompts[static_cast<size_t>(spec.kind)] + name + ": ";
+            while (!parseSplitValue(spec.kind, readString(prompt), weight, exact)) cout << "Invalid value. ";
+        } else {
+            parseSplitValue(spec.kind, "", weight, exact);
+        }
+        names.push_back(name);
+        spec.weights.push_back(weight);
+        spec.amounts.push_back(exact);
+    }
+
+    // The ledger is locked only once the input is complete
+    lock_guard<mutex> lock(ledger->lock);
+    UserId paidBy = internUser(payer);
+    for (const string &name : names) spec.users.push_back(internUser(name));
+
+    string error;
+    if (!recordSplitExpense(description, amount, paidBy, spec, time(nullptr), error)) {
+        cout << "Expense not added: " << error << ".\n";
+        return;
+    }
+    cout << "Expense added successfully.\n";
+}
+
+// ------------------------------
+// Print Expenses
+// ------------------------------
+// Runs on a view of the ledger, so it holds the lock only to take the view
+void printExpenses() {
+    OperationTimer timer(Operation::PrintExpenses);
+    LedgerView view = lockedLedgerView();
+    const ExpenseStore::View &expenses = view.expenses;
+    if (expenses.empty() && reportFormat == ReportFormat::Table) {
+        cout << "No expenses recorded.\n";
+        return;
+    }
+
+    report.begin();
+    if (reportFormat == ReportFormat::Csv) report.text("description,amount,payer,user,owed\n");
+    if (reportFormat == ReportFormat::Json) report.text("[");
+    for (size_t row = 0; row < expenses.size(); ++row) writeExpense(view, row, row == 0, false);
+    if (reportFormat == ReportFormat::Json) report.text("\n]\n");
+    report.flush();
+}
+
+// Writes one expense in the report format; withTime adds its timestamp
+// (a leading column in CSV)
+// Source is the live Ledger (lock held) or a LedgerView
+template <typename Source>
+void writeExpense(const Source &source, size_t row, bool first, bool withTime) {
+    static thread_local string scratch;
+    const auto &users = source.users;
+    const auto &expenses = source.expenses;
+    uint64_t begin = expenses.participantOffsets[row], end = expenses.participantOffsets[row + 1];
+    string_view description = expenses.description(row, scratch);
+    string_view payer = users.name(expenses.payers[row]);
+    switch (reportFormat) {
+        case ReportFormat::Table:
+            report.text("\n--- Expense: ").text(description).text(" ---\n");
+            if (withTime) report.text("Time: ").timestamp(expenses.times[row]).text("\n");
+            report.text("Amount: ").money(expenses.amounts[row]).text(" paid by ").text(payer).text("\n");
+            report.text("Split among:\n");
+            for (uint64_t i = begin; i < end; ++i) {
+                report.text("\t").text(users.name(expenses.participants[i]))
+                      .text(" owes ").money(expenses.owed[i]).text("\n");
+            }
+            break;
+        case ReportFormat::Csv:
+            // One line per participant
+            for (uint64_t i = begin; i < end; ++i) {
+                if (withTime) report.timestamp(expenses.times[row]).text(",");
+                report.csv(description).text(",").money(expenses.amounts[row]).text(",").csv(payer)
+                      .text(",").csv(users.name(expenses.participants[i])).text(",").money(expenses.owed[i]).text("\n");
+            }
+            break;
+        case ReportFormat::Json:
+            report.text(first ? "\n" : ",\n");
+            report.text("{");
+            if (withTime) report.text("\"time\":\"").timestamp(expenses.times[row]).text("\",");
+            report.text("\"description\":").json(description).text(",\"amount\":").money(expenses.amounts[row])
+                  .text(",\"payer\":").json(payer).text(",\"split\":[");
+            for (uint64_t i = begin; i < end; ++i) {
+                report.text(i == begin ? "{\"user\":" : ",{\"user\":").json(users.name(expenses.participants[i]))
+                      .text(",\"owed\":").money(expenses.owed[i]).text("}");
+            }
+            report.text("]}");
+            break;
+    }
+}
+
+// ------------------------------
+// User Expenses
+// ------------------------------
+// Answered from indexes kept as expenses are appended: paidRows for the
+// payer, and userSlots mapped through the slotRows column for participants,
+// so the cost follows the user's own history rather than the ledger size.
+// paidOnly limits the list to expenses the user paid; otherwise it holds
+// every expense the user paid or was split into, each once, in order.
+void printUserExpenses(UserId user, bool paidOnly) {
+    const CowColumn<uint64_t> &slotRows = ledger->expenses.slotRows;
+    const vector<uint64_t> &entries = paidOnly ? ledger->paidRows[user] : ledger->userSlots[user];
+    string_view name = ledger->users.name(user);
+    if (entries.empty() && reportFormat == ReportFormat::Table) {
+        cout << "No expenses " << (paidOnly ? "paid by " : "involving ") << name << ".\n";
+        return;
+    }
+
+    report.begin();
+    if (reportFormat == ReportFormat::Table)
+        report.text(paidOnly ? "\nExpenses paid by " : "\nExpenses involving ").text(name).text(":\n");
+    if (reportFormat == ReportFormat::Csv) report.text("time,description,amount,payer,user,owed\n");
+    if (reportFormat == ReportFormat::Json) report.text("[");
+    uint64_t previous = UINT64_MAX;
+    for (uint64_t entry : entries) {
+        uint64_t row = paidOnly ? entry : slotRows[entry];
+        // A user split into one expense twice holds two slots in its row
+        if (row == previous) continue;
+        writeExpense(*ledger, row, previous == UINT64_MAX, true);
+        previous = row;
+    }
+    if (reportFormat == ReportFormat::Json) report.text("\n]\n");
+    report.flush();
+}
+
+void showUserExpenses(bool paidOnly) {
+    string name = readString("Enter user name: ");
+    lock_guard<mutex> lock(ledger->lock);
+    UserId user;
+    if (!ledger->users.find(name, user)) {
+        cout << "Unknown user " << name << ".\n";
+        return;
+    }
+    printUserExpenses(user, paidOnly);
+}
+
+// ------------------------------
+// Add Settlement (enqueue)
+// ------------------------------
+void enqueueSettlement() {
+    string fromUser = readString("\nEnter the user who will pay: ");
+    string toUser = readString("Enter the user to receive the payment: ");
+    Money amount = readMoney("Enter the amount to settle: ");
+
+    Settlement s;
+    {
+        lock_guard<mutex> lock(ledger->lock);
+        s = {internUser(fromUser), internUser(toUser), amount, time(nullptr)};
+    }
+
+    if (settlementWorkerRunning.load(memory_order_acquire) && settlementWorkerLedger == ledger) {
+        submitSettlement(s);
+        cout << "Settlement submitted to the background processor.\n";
+        return;
+    }
+    {
+        lock_guard<mutex> lock(ledger->lock);
+        ledger->settlements.push(s);
+    }
+    cout << "Settlement added to queue.\n";
+}
+
+// ------------------------------
+// Process Settlement (dequeue)
+// ------------------------------
+void processSettlement() {
+    OperationTimer timer(Operation::ProcessSettlement);
+    if (ledger->settlements.empty()) {
+        cout << "No settlements to process.\n";
+        return;
+    }
+
+    Settlement s = ledger->settlements.front();
+    ledger->settlements.pop();
+
+    cout << "Settling: " << ledger->users.name(s.fromUser) << " pays " << ledger->users.name(s.toUser)
+         << " " << formatMoney(s.amount) << "\n";
+
+    applySettlement(s);
+}
+
+// ------------------------------
+// Apply Settlement (shared by the menu and journal replay)
+// ------------------------------
+void applySettlement(const Settlement &s) {
+    // Update balances
+    ledger->changeBalance(s.fromUser, s.amount);
+    ledger->changeBalance(s.toUser, -s.amount);
+
+    updateExpenseAfterSettlement(s.fromUser, s.toUser, s.amount);
+    ledger->settledLog.push_back(s);
+
+    journalSettlement(s);
+}
+
+// ------------------------------
+// Apply a Batch of Settlements
+// ------------------------------
+// Same result as applying each settlement in turn, but the batch is first
+// netted into one balance change per user, so every affected user's
+// expense slots are rewritten once however many settlements name them.
+void applySettlements(const Settlement *batch, size_t count) {
+    OperationTimer timer(Operation::ApplySettlements);
+    static thread_local vector<Money> delta;
+    static thread_local vector<uint8_t> seen;
+    static thread_local vector<UserId> touched;
+    delta.resize(ledger->users.size(), 0);
+    seen.resize(ledger->users.size(), 0);
+    touched.clear();
+
+    for (size_t i = 0; i < count; ++i) {
+        const Settlement &s = batch[i];
+        for (UserId user : {s.fromUser, s.toUser}) {
+            if (!seen[user]) {
+                seen[user] = 1;
+                touched.push_back(user);
+            }
+        }
+        delta[s.fromUser] += s.amount;
+        delta[s.toUser] -= s.amount;
+    }
+
+    for (UserId user : touched) {
+        Money change = delta[user];
+        if (change != 0) ledger->applyNetChange(user, change, ledger->expenses.owed);
+        delta[user] = 0;
+        seen[user] = 0;
+    }
+
+    // The log and journal still keep every settlement
+    ledger->settledLog.insert(ledger->settledLog.end(), batch, batch + count);
+    journalSettlements(batch, count);
+}
+
+// ------------------------------
+// Process All Settlements
+// ------------------------------
+void processAllSettlements() {
+    if (ledger->settlements.empty()) {
+        cout << "No settlements to process.\n";
+        return;
+    }
+
+    vector<Settlement> batch;
+    batch.reserve(ledger->settlements.size());
+    while (!ledger->settlements.empty()) {
+        batch.push_back(ledger->settlements.front());
+        ledger->settlements.pop();
+    }
+
+    applySettlements(batch.data(), batch.size());
+    cout << "Processed " << batch.size() << " settlements.\n";
+}
+
+// ------------------------------
+// Background Settlement Processor
+// ------------------------------
+// Producers on any thread submit into settlementRing; one worker thread
+// drains it in batches and applies each batch to the ledger it was started
+// on, under that ledger's lock, so the lock is taken once per batch rather
+// than once per settlement. After each batch is journaled the worker
+// advances settlementsJournaled and writes a byte to settlementJournaledPipe,
+// so the server can answer the requests that submitted it.
+const size_t SETTLEMENT_BATCH = 1024;
+
+// Returns the value settlementsJournaled reaches once s is journaled
+uint64_t submitSettlement(const Settlement &s) {
+    // A full ring pushes back on the producer until the worker catches up
+    size_t position;
+    while (!settlementRing.tryPush(s, position)) this_thread::yield();
+    return position + 1;
+}
+
+void settlementWorkerLoop() {
+    LedgerScope scope(*settlementWorkerLedger);
+    vector<Settlement> batch(SETTLEMENT_BATCH);
+    unsigned idleSpins = 0;
+    while (true) {
+        size_t n = settlementRing.popBatch(batch.data(), batch.size());
+        if (n == 0) {
+            if (!settlementWorkerRunning.load(memory_order_acquire)) break;
+            // Spin briefly for bursts, then back off to avoid burning a core
+            if (++idleSpins < 64) this_thread::yield();
+            else this_thread::sleep_for(chrono::microseconds(200));
+            continue;
+        }
+        idleSpins = 0;
+        {
+            lock_guard<mutex> lock(ledger->lock);
+            applySettlements(batch.data(), n);
+            flushJournal();
+        }
+        settlementsJournaled.store(settlementRing.popped(), memory_order_release);
+        // Fails only when the pipe is full, and then a wakeup is pending anyway
+        char wake = 0;
+        ssize_t woken = write(settlementJournaledPipe[1], &wake, 1);
+        (void)woken;
+        settlementsProcessed.fetch_add(n, memory_order_relaxed);
+        settlementBatches.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+// Starts the worker on the calling thread's ledger
+void startSettlementWorker() {
+    if (settlementWorkerRunning.exchange(true)) return;
+    settlementWorkerLedger = ledger;
+    settlementsProcessed = 0;
+    settlementBatches = 0;
+    settlementsJournaled = settlementRing.popped();
+    if (pipe(settlementJournaledPipe) == 0) {
+        fcntl(settlementJournaledPipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(settlementJournaledPipe[1], F_SETFL, O_NONBLOCK);
+    }
+    settlementWorkerStart = chrono::steady_clock::now();
+    settlementWorker = thread(settlementWorkerLoop);
+}
+
+// Drains whatever is queued, then joins the worker. Producers must have
+// stopped submitting before this is called.
+void stopSettlementWorker() {
+    if (!settlementWorkerRunning.exchange(false)) return;
+    settlementWorker.join();
+    for (int &fd : settlementJournaledPipe) {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+}
+
+void printSettlementThroughput() {
+    if (!settlementWorkerRunning.load(memory_order_acquire)) {
+        cout << "Background settlement processor is not running (start with --background).\n";
+        return;
+    }
+    cout << "Group: " << settlementWorkerLedger->name << "\n";
+    uint64_t processed = settlementsProcessed.load(memory_order_relaxed);
+    uint64_t batches = settlementBatches.load(memory_order_relaxed);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - settlementWorkerStart).count();
+    cout << "Processed " << processed << " settlements in " << batches << " batches";
+    if (batches > 0) cout << " (" << fixed << setprecision(1) << static_cast<double>(processed) / batches << " per batch)";
+    cout << "\nThroughput: " << fixed << setprecision(0) << (seconds > 0 ? processed / seconds : 0.0)
+         << " settlements/s over " << setprecision(1) << seconds << " s\n"
+         << "Queued: " << settlementRing.size() << "\n";
+}
+
+// ------------------------------
+// Print All Settlements
+// ------------------------------
+void printSettlements() {
+    if (ledger->settlements.empty()) {
+        cout << "No settlements in the queue.\n";
+        return;
+    }
+
+    queue<Settlement> temp = ledger->settlements;
+    while (!temp.empty()) {
+        Settlement s = temp.front();
+        cout << ledger->users.name(s.fromUser) << " pays " << ledger->users.name(s.toUser)
+             << " " << formatMoney(s.amount) << "\n";
+        temp.pop();
+    }
+}
+
+// ------------------------------
+// Update Expenses After Settlement
+// ------------------------------
+void updateExpenseAfterSettlement(UserId fromUser, UserId toUser, Money amount) {
+    OperationTimer timer(Operation::UpdateExpense);
+    ledger->updateExpenseAfterSettlement(fromUser, toUser, amount, ledger->expenses.owed);
+}
+
+// ------------------------------
+// Print Graph
+// ------------------------------
+// Runs on a view of the ledger, so it holds the lock only to take the view
+void printGraph() {
+    OperationTimer timer(Operation::PrintGraph);
+    LedgerView view = lockedLedgerView();
+    const UserTable::View &users = view.users;
+    const CowColumn<GraphEdge>::View &debtGraph = view.debtGraph;
+    if (debtGraph.empty() && reportFormat == ReportFormat::Table) {
+        cout << "No debts recorded.\n";
+        return;
+    }
+
+    // Group edges by payer with a stable counting sort (CSR offsets)
+    vector<uint32_t> offsets(users.size() + 1, 0);
+    for (size_t i = 0; i < debtGraph.size(); ++i) offsets[debtGraph[i].fromUser + 1]++;
+    for (size_t i = 1; i < offsets.size(); ++i) offsets[i] += offsets[i - 1];
+    vector<uint32_t> order(debtGraph.size());
+    vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0; i < debtGraph.size(); ++i) order[cursor[debtGraph[i].fromUser]++] = i;
+
+    report.begin();
+    if (reportFormat == ReportFormat::Csv) report.text("from,to,amount\n");
+    if (reportFormat == ReportFormat::Json) report.text("[");
+    bool first = true;
+    for (UserId user : *view.nameOrder) {
+        if (offsets[user] == offsets[user + 1]) continue;
+        if (reportFormat == ReportFormat::Table) report.text(users.name(user)).text(" owes:\n");
+        for (uint32_t i = offsets[user]; i < offsets[user + 1]; ++i) {
+            const GraphEdge &edge = debtGraph[order[i]];
+            switch (reportFormat) {
+                case ReportFormat::Table:
+                    report.text("  - ").text(users.name(edge.toUser)).text(": ").money(edge.amount).text("\n");
+                    break;
+                case ReportFormat::Csv:
+                    report.csv(users.name(user)).text(",").csv(users.name(edge.toUser)).text(",").money(edge.amount).text("\n");
+                    break;
+                case ReportFormat::Json:
+                    report.text(first ? "\n" : ",\n").text("{\"from\":").json(users.name(user))
+                          .text(",\"to\":").json(users.name(edge.toUser)).text(",\"amount\":").money(edge.amount).text("}");
+                    break;
+            }
+            first = false;
+        }
+    }
+    if (reportFormat == ReportFormat::Json) report.text("\n]\n");
+    report.flush();
+}
+
+// ------------------------------
+// Simplify Debts (minimum cash flow)
+// ------------------------------
+// Nets userBalances into the fewest transfers by repeatedly matching the
+// largest creditor with the largest debtor. Each step settles at least one
+// of the two, so the plan has fewer than U transfers and costs O(U log U).
+vector<Settlement> simplifyDebts() {
+    priority_queue<pair<Money, UserId>> creditors, debtors;
+    for (UserId user = 0; user < ledger->userBalances.size(); ++user) {
+        if (ledger->userBalances[user] > 0)
+            creditors.push({ledger->userBalances[user], user});
+        else if (ledger->userBalances[user] < 0)
+            debtors.push({-ledger->userBalances[user], user});
+    }
+
+    vector<Settlement> plan;
+    while (!creditors.empty() && !debtors.empty()) {
+        auto credit = creditors.top();
+        auto debt = debtors.top();
+        creditors.pop();
+        debtors.pop();
+
+        Money amount = min(credit.first, debt.first);
+        plan.push_back({debt.second, credit.second, amount, 0});
+
+        if (credit.first > amount)
+            creditors.push({credit.first - amount, credit.second});
+        if (debt.first > amount)
+            debtors.push({debt.first - amount, debt.second});
+    }
+    return plan;
+}
+
+void printSimplifiedDebts() {
+    vector<Settlement> plan = simplifyDebts();
+    if (plan.empty()) {
+        cout << "No debts to simplify.\n";
+        return;
+    }
+
+    cout << "\nSimplified Settlements:\n";
+    for (const auto &s : plan) {
+        cout << ledger->users.name(s.fromUser) << " pays " << ledger->users.name(s.toUser)
+             << " " << formatMoney(s.amount) << "\n";
+    }
+}
+
+// ------------------------------
+// Cancel Debt Cycles
+// ------------------------------
+// A cycle A -> B -> C -> A in the debt graph can be reduced by its smallest
+// edge without changing anyone's net balance. The pass is an iterative DFS
+// over a CSR copy of the graph, with the DFS paths kept in a LinkCutForest
+// instead of an explicit stack: the search always extends the root of the
+// current tree, and an edge from that root back into its own tree closes a
+// cycle. Its minimum and the reduction along it then cost O(log V) instead
+// of a walk over the whole cycle, and the edges that reach zero are cut out
+// of the tree, so the pass takes O(E log V). It works on a plain copy of
+// the graph; the edges left non-zero then replace the column and the edge
+// index is rebuilt.
+CycleStats cancelDebtCycles() {
+    auto start = chrono::steady_clock::now();
+    vector<GraphEdge> debtGraph(ledger->debtGraph.size());
+    ledger->debtGraph.forEachSpan([&, copied = size_t(0)](const GraphEdge *edges, size_t count) mutable {
+        copy(edges, edges + count, debtGraph.begin() + copied);
+        copied += count;
+    });
+    CycleStats stats;
+    size_t userCount = ledger->users.size();
+
+    // Edges grouped by debtor, as positions in debtGraph
+    vector<uint32_t> offsets(userCount + 1, 0);
+    for (const auto &edge : debtGraph) offsets[edge.fromUser + 1]++;
+    for (size_t i = 1; i < offsets.size(); ++i) offsets[i] += offsets[i - 1];
+    vector<uint32_t> adjacency(debtGraph.size());
+    vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0; i < debtGraph.size(); ++i) adjacency[next[debtGraph[i].fromUser]++] = i;
+    copy(offsets.begin(), offsets.end() - 1, next.begin());
+
+    // While an edge is in the forest its amount lives there; cutting it
+    // writes the amount back
+    LinkCutForest forest(userCount);
+    vector<uint8_t> finished(userCount, 0);
+    vector<uint32_t> treeParent(userCount, LinkCutForest::NIL);
+    vector<vector<UserId>> children(userCount);
+    auto cut = [&](UserId user) {
+        uint32_t e = forest.nodes[user].edge;
+        debtGraph[e].amount = forest.cut(user);
+        treeParent[user] = LinkCutForest::NIL;
+    };
+
+    for (UserId source = 0; source < userCount; ++source) {
+        UserId user = forest.findRoot(source);     // Kept as the root of source's tree
+        while (!finished[source]) {
+            uint32_t &cursor = next[user];
+            while (cursor < offsets[user + 1] && (debtGraph[adjacency[cursor]].amount <= 0 ||
+                                                   finished[debtGraph[adjacency[cursor]].toUser]))
+                cursor++;
+
+            if (cursor == offsets[user + 1]) {
+                // Nothing left to explore: no cycle runs through this user
+                finished[user] = 1;
+                for (UserId child : children[user]) {
+                    if (treeParent[child] == user) cut(child);
+                }
+                vector<UserId>().swap(children[user]);
+                user = forest.findRoot(source);
+                continue;
+            }
+
+            GraphEdge &edge = debtGraph[adjacency[cursor]];
+            UserId to = edge.toUser;
+            UserId root = to == user ? user : forest.findRoot(to);
+            if (root != user) {
+                forest.link(user, to, edge.amount, adjacency[cursor]);
+                treeParent[user] = to;
+                children[to].push_back(user);
+                cursor++;
+                user = root;
+                continue;
+            }
+
+            // The tree path from `to` up to `user`, plus this edge, is a cycle
+            Money smallest = edge.amount;
+            size_t length = 1;
+            if (to != user) {
+                // After access(to), to's splay tree is that whole path
+                forest.access(to);
+                smallest = min(smallest, forest.nodes[to].minCost);
+                length += forest.nodes[to].size - 1;
+                forest.add(to, -smallest);
+                bool split = false;
+                while (forest.nodes[to].minCost == 0) {
+                    cut(forest.pathArgMin(to));
+                    forest.access(to);
+                    split = true;
+                }
+                if (split) user = forest.findRoot(source);
+            }
+            edge.amount -= smallest;
+            stats.cycles++;
+            stats.weightRemoved += smallest * static_cast<Money>(length);
+        }
+    }
+
+    // Drop the edges that are now zero and re-index the rest
+    size_t kept = 0;
+    for (const auto &edge : debtGraph) {
+        if (edge.amount != 0) debtGraph[kept++] = edge;
+    }
+    stats.edgesRemoved = debtGraph.size() - kept;
+    debtGraph.resize(kept);
+    ledger->debtGraph.assign(debtGraph.data(), debtGraph.size());
+    ledger->debtEdgeIndex = EdgeIndex();
+    for (uint32_t i = 0; i < debtGraph.size(); ++i)
+        ledger->debtEdgeIndex.insert(EdgeIndex::key(debtGraph[i].fromUser, debtGraph[i].toUser), i);
+
+    journalCycleCancellation();
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+void printCycleStats(const CycleStats &stats) {
+    cout << "Cancelled " << stats.cycles << " debt cycles in " << fixed << setprecision(3) << stats.seconds
+         << "s, removing " << formatMoney(stats.weightRemoved) << " of edge weight and "
+         << stats.edgesRemoved << " edges (" << ledger->debtGraph.size() << " left).\n";
+}
+
+// ------------------------------
+// Print Balances
+// ------------------------------
+// Runs on a view of the ledger, so it holds the lock only to take the view
+void printBalances() {
+    LedgerView view = lockedLedgerView();
+    printBalances(view, view.userBalances, "User Balances");
+}
+
+// Prints one balance per user, indexed by UserId, under the given title and
+// the names in view
+template <typename Balances>
+void printBalances(const LedgerView &view, const Balances &userBalances, string_view title) {
+    OperationTimer timer(Operation::PrintBalances);
+    const UserTable::View &users = view.users;
+    if (userBalances.empty() && reportFormat == ReportFormat::Table) {
+        cout << "No balances recorded.\n";
+        return;
+    }
+
+    report.begin();
+    if (reportFormat == ReportFormat::Table) report.text("\n").text(title).text(":\n");
+    if (reportFormat == ReportFormat::Csv) report.text("user,balance\n");
+    if (reportFormat == ReportFormat::Json) report.text("[");
+    bool first = true;
+    for (UserId user : *view.nameOrder) {
+        switch (reportFormat) {
+            case ReportFormat::Table:
+                report.text(users.name(user)).text(": ").money(userBalances[user]).text("\n");
+                break;
+            case ReportFormat::Csv:
+                report.csv(users.name(user)).text(",").money(userBalances[user]).text("\n");
+                break;
+            case ReportFormat::Json:
+                report.text(first ? "\n" : ",\n").text("{\"user\":").json(users.name(user))
+                      .text(",\"balance\":").money(userBalances[user]).text("}");
+                break;
+        }
+        first = false;
+    }
+    if (reportFormat == ReportFormat::Json) report.text("\n]\n");
+    report.flush();
+}
+
+// ------------------------------
+// Report Format
+// ------------------------------
+bool parseReportFormat(string_view name, ReportFormat &format) {
+    if (name == "table") format = ReportFormat::Table;
+    else if (name == "csv") format = ReportFormat::Csv;
+    else if (name == "json") format = ReportFormat::Json;
+    else return false;
+    return true;
+}
+
+void chooseReportFormat() {
+    string name = readString("Enter report format (table, csv, json): ");
+    if (!parseReportFormat(name, reportFormat)) {
+        cout << "Unknown format; keeping the current one.\n";
+        return;
+    }
+    cout << "Reports will be printed as " << name << ".\n";
+}
+
+// ------------------------------
+// Print Top Creditors and Debtors
+// ------------------------------
+void printTopBalances(size_t count) {
+    vector<UserId> ranked;
+    ledger->creditorHeap.top(count, ranked);
+    cout << "\nTop Creditors:\n";
+    if (ranked.empty()) cout << "None.\n";
+    for (UserId user : ranked) cout << ledger->users.name(user) << ": " << formatMoney(ledger->userBalances[user]) << "\n";
+
+    ranked.clear();
+    ledger->debtorHeap.top(count, ranked);
+    cout << "\nTop Debtors:\n";
+    if (ranked.empty()) cout << "None.\n";
+    for (UserId user : ranked) cout << ledger->users.name(user) << ": " << formatMoney(ledger->userBalances[user]) << "\n";
+}
+
+// ------------------------------
+// Audit Balances
+// ------------------------------
+// Recomputes every balance from the original expense splits and the applied
+// settlements, and reports users whose incremental balance disagrees. Each
+// thread sums a slice of the ledger into its own partial balance array; the
+// partials are then merged, again in parallel, one user range per thread.
+bool auditBalances() {
+    const UserTable &users = ledger->users;
+    const ExpenseStore &expenses = ledger->expenses;
+    const vector<Settlement> &settledLog = ledger->settledLog;
+    const CowColumn<Money> &userBalances = ledger->userBalances;
+    auto start = chrono::steady_clock::now();
+    size_t userCount = users.size();
+    size_t rows = expenses.size();
+    size_t threadCount = max(1u, thread::hardware_concurrency());
+    threadCount = min(threadCount, max<size_t>(1, rows / 4096));
+
+    vector<vector<Money>> partials(threadCount);
+    vector<thread> workers;
+    for (size_t t = 0; t < threadCount; ++t) {
+        workers.emplace_back([&, t]() {
+            vector<Money> &partial = partials[t];
+            partial.assign(userCount, 0);
+
+            size_t begin = rows * t / threadCount, end = rows * (t + 1) / threadCount;
+            for (size_t row = begin; row < end; ++row) {
+                UserId payer = expenses.payers[row];
+                for (uint64_t slot = expenses.participantOffsets[row] + 1; slot < expenses.participantOffsets[row + 1]; ++slot) {
+                    partial[payer] += expenses.shares[slot];
+                    partial[expenses.participants[slot]] -= expenses.shares[slot];
+                }
+            }
+
+            begin = settledLog.size() * t / threadCount;
+            end = settledLog.size() * (t + 1) / threadCount;
+            for (size_t i = begin; i < end; ++i) {
+                partial[settledLog[i].fromUser] += settledLog[i].amount;
+                partial[settledLog[i].toUser] -= settledLog[i].amount;
+            }
+        });
+    }
+    for (auto &worker : workers) worker.join();
+    workers.clear();
+
+    // Merge into partials[0], each thread owning a slice of users
+    for (size_t t = 0; t < threadCount; ++t) {
+        workers.emplace_back([&, t]() {
+            size_t begin = userCount * t / threadCount, end = userCount * (t + 1) / threadCount;
+            for (size_t p = 1; p < threadCount; ++p)
+                for (size_t user = begin; user < end; ++user) partials[0][user] += partials[p][user];
+        });
+    }
+    for (auto &worker : workers) worker.join();
+
+    const size_t reportLimit = 20;
+    size_t mismatches = 0;
+    for (UserId user = 0; user < userCount; ++user) {
+        if (partials[0][user] == userBalances[user]) continue;
+        if (++mismatches <= reportLimit) {
+            cout << users.name(user) << ": recorded " << formatMoney(userBalances[user])
+                 << ", expected " << formatMoney(partials[0][user]) << "\n";
+        }
+    }
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    if (mismatches > reportLimit) cout << "... and " << mismatches - reportLimit << " more\n";
+    cout << "Audited " << rows << " expenses and " << settledLog.size() << " settlements for "
+         << userCount << " users on " << threadCount << " threads in " << fixed << setprecision(1)
+         << ms << " ms: " << (mismatches == 0 ? "all balances match" : to_string(mismatches) + " mismatches")
+         << ".\n";
+    return mismatches == 0;
+}
+
+// ------------------------------
+// Operation Stats
+// ------------------------------
+// With --stats (or once the menu's stats option has been used) the hot
+// entry points time themselves with an OperationTimer. Reports merge every
+// thread's histograms; latencies are in nanoseconds.
+void printOperationStats() {
+    if (!statsEnabled.exchange(true) && reportFormat == ReportFormat::Table) {
+        cout << "Operation stats were off and are now being recorded.\n";
+        return;
+    }
+
+    // The tick rate is measured over the life of the process
+    double nsPerTick = 1;
+#if defined(__x86_64__)
+    double elapsedNs = chrono::duration<double, nano>(chrono::steady_clock::now() - statsClockOrigin).count();
+    uint64_t elapsedTicks = statsTicks() - statsTicksOrigin;
+    if (elapsedTicks > 0) nsPerTick = elapsedNs / elapsedTicks;
+#endif
+    auto ns = [&](uint64_t ticks) { return to_string(static_cast<uint64_t>(ticks * nsPerTick + 0.5)); };
+
+    vector<uint64_t> counts(LatencyHistogram::BUCKETS);
+    report.begin();
+    if (reportFormat == ReportFormat::Table) {
+        report.text("\nOperation Stats (ns):\n");
+        char line[128];
+        snprintf(line, sizeof(line), "%-30s %10s %10s %10s %10s %10s %12s\n",
+                 "operation", "count", "mean", "p50", "p90", "p99", "max");
+        report.text(line);
+    }
+    if (reportFormat == ReportFormat::Csv) report.text("operation,count,mean_ns,p50_ns,p90_ns,p99_ns,max_ns\n");
+    if (reportFormat == ReportFormat::Json) report.text("[");
+
+    lock_guard<mutex> lock(statsLock);
+    for (size_t op = 0; op < OPERATION_COUNT; ++op) {
+        uint64_t total = 0, sum = 0, longest = 0;
+        fill(counts.begin(), counts.end(), 0);
+        for (const auto &stats : allStats) {
+            const LatencyHistogram &histogram = stats->histograms[op];
+            total += histogram.total.load(memory_order_relaxed);
+            sum += histogram.sum.load(memory_order_relaxed);
+            longest = max(longest, histogram.max.load(memory_order_relaxed));
+            for (size_t i = 0; i < counts.size(); ++i) counts[i] += histogram.counts[i].load(memory_order_relaxed);
+        }
+
+        // Each percentile is the highest value its bucket can hold
+        uint64_t percentiles[3] = {};
+        const uint64_t ranks[3] = {50, 90, 99};
+        for (size_t p = 0, i = 0, seen = 0; p < 3 && total > 0; ++p) {
+            uint64_t wanted = (total * ranks[p] + 99) / 100;
+            while (seen + counts[i] < wanted) seen += counts[i++];
+            percentiles[p] = min(longest, LatencyHistogram::lowest(i + 1) - 1);
+        }
+        uint64_t mean = total > 0 ? sum / total : 0;
+
+        switch (reportFormat) {
+            case ReportFormat::Table: {
+                char line[128];
+                snprintf(line, sizeof(line), "%-30s %10llu %10s %10s %10s %10s %12s\n", OPERATION_NAMES[op],
+                         static_cast<unsigned long long>(total), ns(mean).c_str(), ns(percentiles[0]).c_str(),
+                         ns(percentiles[1]).c_str(), ns(percentiles[2]).c_str(), ns(longest).c_str());
+                report.text(line);
+                break;
+            }
+            case ReportFormat::Csv:
+                report.text(OPERATION_NAMES[op]).text(",").text(to_string(total)).text(",").text(ns(mean))
+                      .text(",").text(ns(percentiles[0])).text(",").text(ns(percentiles[1]))
+                      .text(",").text(ns(percentiles[2])).text(",").text(ns(longest)).text("\n");
+                break;
+            case ReportFormat::Json:
+                // Non-empty buckets as [lowest value, count]
+                report.text(op == 0 ? "\n" : ",\n").text("{\"operation\":").json(OPERATION_NAMES[op])
+                      .text(",\"count\":").text(to_string(total)).text(",\"mean_ns\":").text(ns(mean))
+                      .text(",\"p50_ns\":").text(ns(percentiles[0])).text(",\"p90_ns\":").text(ns(percentiles[1]))
+                      .text(",\"p99_ns\":").text(ns(percentiles[2])).text(",\"max_ns\":").text(ns(longest))
+                      .text(",\"histogram\":[");
+                for (size_t i = 0, first = 1; i < counts.size(); ++i) {
+                    if (counts[i] == 0) continue;
+                    report.text(first ? "[" : ",[").text(ns(LatencyHistogram::lowest(i))).text(",")
+                          .text(to_string(counts[i])).text("]");
+                    first = 0;
+                }
+                report.text("]}");
+                break;
+        }
+    }
+    if (reportFormat == ReportFormat::Json) report.text("\n]\n");
+    report.flush();
+}
+
+// ------------------------------
+// Expense History
+// ------------------------------
+// Range and as-of queries over the ledger's time index (ExpenseHistory).
+// Expenses made at the menu are stamped with the current time; ingested
+// records may carry their own (see Batch Ingestion).
+
+// Accepts seconds since the epoch, YYYY-MM-DD or YYYY-MM-DDTHH:MM[:SS]
+// (a space may stand for the T, and a trailing Z is allowed), all in UTC.
+// A bare date means its first second, or its last with endOfDay.
+bool parseTimestamp(string_view text, Timestamp &time, bool endOfDay) {
+    auto number = [&](size_t at, size_t count, int &value) {
+        if (at + count > text.size()) return false;
+        value = 0;
+        for (size_t i = at; i < at + count; ++i) {
+            if (text[i] < '0' || text[i] > '9') return false;
+            value = value * 10 + (text[i] - '0');
+        }
+        return true;
+    };
+
+    if (!text.empty() && text.back() == 'Z') text.remove_suffix(1);
+    if (text.empty()) return false;
+    if (text.size() <= 18 && all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        time = 0;
+        for (char c : text) time = time * 10 + (c - '0');
+        return true;
+    }
+
+    int year, month, day, hour = 0, minute = 0, second = 0;
+    if (!number(0, 4, year) || text.size() < 10 || text[4] != '-' || !number(5, 2, month) ||
+        text[7] != '-' || !number(8, 2, day))
+        return false;
+    if (text.size() == 10) {
+        if (endOfDay) hour = 23, minute = 59, second = 59;
+    } else if (!((text[10] == 'T' || text[10] == ' ') && number(11, 2, hour) && text.size() >= 16 &&
+                 text[13] == ':' && number(14, 2, minute) &&
+                 (text.size() == 16 || (text.size() == 19 && text[16] == ':' && number(17, 2, second))))) {
+        return false;
+    }
+    if (month < 1 || month > 12 || day < 1 || hour > 23 || minute > 59 || second > 59) return false;
+
+    struct tm parts = {};
+    parts.tm_year = year - 1900;
+    parts.tm_mon = month - 1;
+    parts.tm_mday = day;
+    parts.tm_hour = hour;
+    parts.tm_min = minute;
+    parts.tm_sec = second;
+    time_t seconds = timegm(&parts);
+    if (parts.tm_mday != day) return false; // timegm rolled an invalid day over (e.g. 02-30)
+    time = seconds;
+    return true;
+}
+
+Timestamp readTimestamp(const string &prompt, bool endOfDay) {
+    Timestamp time;
+    while (!parseTimestamp(readString(prompt), time, endOfDay)) {
+        cout << "Enter a date as YYYY-MM-DD or YYYY-MM-DDTHH:MM[:SS] (UTC), or seconds since 1970.\n";
+    }
+    return time;
+}
+
+// Expenses and settlements made between from and to, inclusive, in time order
+void printExpenseHistory(Timestamp from, Timestamp to) {
+    const UserTable &users = ledger->users;
+    const vector<Settlement> &settledLog = ledger->settledLog;
+    ExpenseHistory &history = ledger->history;
+    history.sync(ledger->expenses, settledLog, users.size());
+    auto begin = history.events.begin() + history.position(from - 1);
+    auto end = history.events.begin() + history.position(to);
+    if (from > to) end = begin;
+
+    size_t expenseCount = 0, settlementCount = 0;
+    for (auto it = begin; it != end; ++it) (it->isSettlement() ? settlementCount : expenseCount)++;
+    if (begin == end && reportFormat == ReportFormat::Table) {
+        cout << "No expenses or settlements in that period.\n";
+        return;
+    }
+
+    report.begin();
+    if (reportFormat == ReportFormat::Csv) report.text("time,description,amount,payer,user,owed\n");
+    if (reportFormat == ReportFormat::Json) report.text("{\"expenses\":[");
+    bool first = true;
+    for (auto it = begin; it != end; ++it) {
+        if (it->isSettlement()) continue;
+        writeExpense(*ledger, it->index(), first, true);
+        first = false;
+    }
+
+    switch (reportFormat) {
+        case ReportFormat::Table:
+            if (settlementCount > 0) report.text("\nSettlements:\n");
+            break;
+        case ReportFormat::Csv:
+            report.text("\ntime,from,to,amount\n");
+            break;
+        case ReportFormat::Json:
+            report.text(expenseCount > 0 ? "\n],\"settlements\":[" : "],\"settlements\":[");
+            break;
+    }
+    first = true;
+    for (auto it = begin; it != end; ++it) {
+        if (!it->isSettlement()) continue;
+        const Settlement &s = settledLog[it->index()];
+        string_view fromUser = users.name(s.fromUser), toUser = users.name(s.toUser);
+        switch (reportFormat) {
+            case ReportFormat::Table:
+                report.timestamp(s.time).text(": ").text(fromUser).text(" pays ").text(toUser)
+                      .text(" ").money(s.amount).text("\n");
+                break;
+            case ReportFormat::Csv:
+                report.timestamp(s.time).text(",").csv(fromUser).text(",").csv(toUser)
+                      .text(",").money(s.amount).text("\n");
+                break;
+            case ReportFormat::Json:
+                report.text(first ? "\n" : ",\n").text("{\"time\":\"").timestamp(s.time)
+                      .text("\",\"from\":").json(fromUser).text(",\"to\":").json(toUser)
+                      .text(",\"amount\":").money(s.amount).text("}");
+                break;
+        }
+        first = false;
+    }
+    if (reportFormat == ReportFormat::Json) report.text(settlementCount > 0 ? "\n]}\n" : "]}\n");
+    report.flush();
+}
+
+// Balances counting only the expenses and settlements made at or before time
+void printBalancesAsOf(Timestamp time) {
+    ExpenseHistory &history = ledger->history;
+    size_t userCount = ledger->users.size();
+    history.sync(ledger->expenses, ledger->settledLog, userCount);
+
+    vector<Money> balances;
+    history.balancesAt(history.position(time), ledger->expenses, ledger->settledLog, userCount, balances);
+    printBalances(viewLedger(), balances, "User Balances as of " + formatTimestamp(time));
+}
+
+void showExpenseHistory() {
+    Timestamp from = readTimestamp("Enter the start date: ", false);
+    Timestamp to = readTimestamp("Enter the end date: ", true);
+    lock_guard<mutex> lock(ledger->lock);
+    printExpenseHistory(from, to);
+}
+
+void showBalancesAsOf() {
+    Timestamp time = readTimestamp("Enter the date: ", true);
+    lock_guard<mutex> lock(ledger->lock);
+    printBalancesAsOf(time);
+}
+
 // ------------------------------
-// Structures & Classes
+// Batch Ingestion
 // ------------------------------
+// Records, one per line, comma- or tab-separated (a tab on the first record
+// line selects TSV). Blank lines and lines starting with '#' are ignored.
+//   expense,<description>,<amount>,<payer>,<user1>,<user2>,...
+//   expense:<split>,<description>,<amount>,<payer>,<user1>=<value>,...
+//   settle,<fromUser>,<toUser>,<amount>
+// A plain expense is shared equally by the payer and the listed users. An
+// itemized one is shared by the listed users only (the payer included if
+// listed), by <split>: equal (names without values), weights, shares,
+// percent or exact amounts, e.g.
+//   expense:percent,Rent,1500.00,alice,alice=50,bob=30,carol=20
+// Any record may start with a timestamp field (see parseTimestamp), e.g.
+//   2024-03-01T18:30,expense,Dinner,60.00,alice,bob,carol
+// Records without one are stamped with the time the ingestion started.
+// The file is mapped read-only and fields are views into the mapping, so a
+// line is parsed without copying; only new user names and descriptions are
+// stored. With --data, the journal is written in batches while the file is
+// read and a single snapshot is taken at the end.
 
-struct Expense {
-    string description;
-    float amount;
-    string paidBy;
-    vector<string> splitAmong;
-    vector<float> amountOwed;
-};
+// Splits [line, end) on delimiter into views (no quoting)
+void splitFields(const char *line, const char *end, char delimiter, vector<string_view> &fields) {
+    fields.clear();
+    while (true) {
+        const char *stop = static_cast<const char *>(memchr(line, delimiter, end - line));
+        if (stop == nullptr) {
+            fields.emplace_back(line, end - line);
+            return;
+        }
+        fields.emplace_back(line, stop - line);
+        line = stop + 1;
+    }
+}
 
-struct Settlement {
-    string fromUser;
-    string toUser;
-    float amount;
+// Records one plain or itemized expense from its fields, the first being
+// the record type. Returns false if the record is malformed, with the reason
+// in error when there is more to say than that.
+bool recordExpenseFields(const vector<string_view> &fields, Timestamp time, string &error) {
+    static thread_local vector<UserId> debtors;
+    static thread_local SplitSpec spec;
+    Money amount;
+    if (fields[0] == "expense" && fields.size() >= 4 && parseMoney(fields[2], amount)) {
+        UserId paidBy = internUser(fields[3]);
+        debtors.clear();
+        for (size_t i = 4; i < fields.size(); ++i) debtors.push_back(internUser(fields[i]));
+        recordExpense(fields[1], amount, paidBy, debtors, time);
+        return true;
+    }
+    if (fields[0].substr(0, 8) != "expense:" || fields.size() < 5 ||
+        !parseSplitKind(fields[0].substr(8), spec.kind) || !parseMoney(fields[2], amount))
+        return false;
+
+    spec.users.clear();
+    spec.weights.clear();
+    spec.amounts.clear();
+    for (size_t i = 4; i < fields.size(); ++i) {
+        string_view entry = fields[i], value;
+        size_t equals = entry.find('=');
+        if (equals != string_view::npos) {
+            value = entry.substr(equals + 1);
+            entry = entry.substr(0, equals);
+        }
+        double weight;
+        Money exact;
+        if (entry.empty() || !parseSplitValue(spec.kind, value, weight, exact)) {
+            error = "bad split entry '" + string(fields[i]) + "'";
+            return false;
+        }
+        spec.users.push_back(internUser(entry));
+        spec.weights.push_back(weight);
+        spec.amounts.push_back(exact);
+    }
+    return recordSplitExpense(fields[1], amount, internUser(fields[3]), spec, time, error);
+}
+
+bool parseSettlementFields(const vector<string_view> &fields, Timestamp time, Settlement &s) {
+    Money amount;
+    if (fields[0] != "settle" || fields.size() != 4 || !parseMoney(fields[3], amount)) return false;
+    s = {internUser(fields[1]), internUser(fields[2]), amount, time};
+    return true;
+}
+
+bool ingestFile(const char *path, IngestStats &stats) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        cerr << "Cannot open " << path << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        cerr << "Cannot stat " << path << ": " << strerror(errno) << "\n";
+        close(fd);
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(info.st_size);
+    const char *data = nullptr;
+    if (size > 0) {
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            cerr << "Cannot map " << path << ": " << strerror(errno) << "\n";
+            close(fd);
+            return false;
+        }
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        data = static_cast<const char *>(mapping);
+    }
+    close(fd);
+
+    auto start = chrono::steady_clock::now();
+    size_t lineNumber = 0;
+    char delimiter = 0;
+    vector<string_view> fields;
+    vector<Settlement> pending;                    // Settlements since the last expense
+    Timestamp ingestTime = time(nullptr);
+    ledger->batchingJournal = true;
+
+    const char *end = data + size;
+    for (const char *line = data; line < end; ) {
+        const char *eol = static_cast<const char *>(memchr(line, '\n', end - line));
+        if (eol == nullptr) eol = end;
+        const char *next = eol < end ? eol + 1 : end;
+        if (eol > line && eol[-1] == '\r') eol--;
+        lineNumber++;
+
+        if (eol == line || *line == '#') {
+            line = next;
+            continue;
+        }
+        if (delimiter == 0)
+            delimiter = memchr(line, '\t', eol - line) ? '\t' : ',';
+        splitFields(line, eol, delimiter, fields);
+        line = next;
+
+        Timestamp recordTime = ingestTime;
+        if (fields.size() > 1 && fields[0].substr(0, 7) != "expense" && fields[0] != "settle" &&
+            parseTimestamp(fields[0], recordTime, false))
+            fields.erase(fields.begin());
+
+        Settlement settlement;
+        string error;
+        if (fields[0].substr(0, 7) == "expense") {
+            // Apply the settlements read so far as one batch; they must
+            // only reach the expenses recorded before them
+            if (!pending.empty()) {
+                applySettlements(pending.data(), pending.size());
+                pending.clear();
+            }
+            if (recordExpenseFields(fields, recordTime, error)) {
+                stats.expenseCount++;
+            } else {
+                cerr << string(path) + ":" + to_string(lineNumber) + ": skipping " +
+                        (error.empty() ? "malformed record\n" : "expense: " + error + "\n");
+                stats.skipped++;
+            }
+        } else if (parseSettlementFields(fields, recordTime, settlement)) {
+            pending.push_back(settlement);
+            stats.settlementCount++;
+        } else {
+            // One write per message, since several files may be ingesting at once
+            cerr << string(path) + ":" + to_string(lineNumber) + ": skipping malformed record\n";
+            stats.skipped++;
+        }
+    }
+
+    if (!pending.empty()) applySettlements(pending.data(), pending.size());
+    if (data != nullptr) munmap(const_cast<char *>(data), size);
+    ledger->batchingJournal = false;
+    writeSnapshot();
+
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+void printIngestSummary(const char *path, const IngestStats &stats) {
+    size_t records = stats.expenseCount + stats.settlementCount;
+    cout << "Ingested " << stats.expenseCount << " expenses and " << stats.settlementCount
+         << " settlements from " << path << " in " << fixed << setprecision(3)
+         << stats.seconds << "s";
+    if (stats.seconds > 0) cout << " (" << static_cast<long long>(records / stats.seconds) << " records/s)";
+    cout << "\n";
+    if (stats.skipped > 0) cout << "Skipped " << stats.skipped << " malformed records.\n";
+}
+
+// ------------------------------
+// Persistence: Journal and Snapshots
+// ------------------------------
+// With --data <prefix>, every change is appended to <prefix>.journal as a
+// binary record, and every SNAPSHOT_INTERVAL records (and on exit) the
+// whole ledger is written to <prefix>.snapshot as flat arrays that are
+// mapped straight back in on startup; the expense columns and debt graph are
+// used from the mapping in place, and the per-user lists and edge index are
+// stored alongside them rather than rebuilt. Startup loads the snapshot, then
+// replays only the journal records newer than it. Users are journaled as
+// they are interned, so replay reproduces the same ids. The pending
+// settlement queue is not persisted. Each group's ledger has its own files
+// (see openGroup).
+
+const uint64_t SNAPSHOT_INTERVAL = 1000000;
+const char SNAPSHOT_MAGIC[8] = {'P', 'T', 'S', 'N', 'A', 'P', '0', '5'};
+const char JOURNAL_MAGIC[8] = {'P', 'T', 'J', 'R', 'N', 'L', '0', '3'};
+
+enum JournalRecordType : uint32_t {
+    JOURNAL_USER = 1,       // payload: name bytes
+    JOURNAL_EXPENSE = 2,    // payload: JournalExpense, participants, owed, description
+    JOURNAL_SETTLEMENT = 3, // payload: Settlement
+    JOURNAL_CYCLES = 4      // no payload; replay runs cancelDebtCycles() again
 };
 
-struct UserBalance {
-    string userName;
-    float balance = 0.0f;
+struct JournalRecordHeader {
+    uint32_t type;
+    uint32_t size;          // payload bytes following the header
+    uint64_t sequence;
 };
 
-struct GraphEdge {
-    string toUser;
-    float amount;
+struct JournalExpense {
+    Money amount;
+    Timestamp time;
+    UserId paidBy;
+    uint32_t participantCount;
+    uint32_t descriptionSize;
+    uint32_t reserved;
 };
 
-struct GraphNode {
-    string userName;
-    vector<GraphEdge> edges;
+struct SnapshotHeader {
+    char magic[8];
+    uint64_t sequence;      // last journal record included
+    uint64_t userCount;
+    uint64_t nameBytes;
+    uint64_t expenseCount;
+    uint64_t participantCount;
+    uint64_t descriptionBytes;
+    uint64_t edgeCount;
+    uint64_t settlementCount;
+    uint64_t edgeSlots;     // size of the stored edge index table
 };
 
-// ------------------------------
-// Global Data Structures
-// ------------------------------
-vector<Expense> expenses;                          // List of expenses
-queue<Settlement> settlements;                     // Queue for settlements
-map<string, float> userBalances;                   // User balances (acts like BST)
-map<string, vector<GraphEdge>> debtGraph;          // Graph for user debts
+// After the columns come the derived indexes, so startup need not rebuild
+// them record by record: each user's participant slots and paid rows as
+// offset/list pairs, then the edge index table as it is in memory.
 
-// ------------------------------
-// Function Prototypes
-// ------------------------------
-void addExpense();
-void printExpenses();
-void enqueueSettlement();
-void processSettlement();
-void printBalances();
-void printSettlements();
-void addDebtToGraph(const string &fromUser, const string &toUser, float amount);
-void printGraph();
-void updateExpenseAfterSettlement(const string &fromUser, const string &toUser, float amount);
+// While an ingest is batching the journal, records collect in journalBatch
+// and go out JOURNAL_BATCH_BYTES at a time instead of one write per record
+const size_t JOURNAL_BATCH_BYTES = 4 << 20;
 
-// ------------------------------
-// Helper: Read line input
-// ------------------------------
-string readString(const string &prompt) {
-    cout << prompt;
-    string input;
-    getline(cin, input);
-    return input;
+void writeJournalBatch() {
+    vector<char> &batch = ledger->journalBatch;
+    if (!batch.empty()) fwrite(batch.data(), 1, batch.size(), ledger->journalFile);
+    batch.clear();
 }
 
-// ------------------------------
-// Add Expense
-// ------------------------------
-void addExpense() {
-    Expense newExpense;
-    cout << "\nEnter expense description: ";
-    getline(cin, newExpense.description);
+void writeJournalRecord(JournalRecordType type, const vector<char> &payload) {
+    if (ledger->journalFile == nullptr) return;
 
-    cout << "Enter total amount: ";
-    cin >> newExpense.amount;
-    cin.ignore();
+    JournalRecordHeader header = {type, static_cast<uint32_t>(payload.size()), ++ledger->journalSequence};
+    ledger->recordsSinceSnapshot++;
+    if (!ledger->batchingJournal) {
+        fwrite(&header, sizeof(header), 1, ledger->journalFile);
+        fwrite(payload.data(), 1, payload.size(), ledger->journalFile);
+        return;
+    }
+    vector<char> &batch = ledger->journalBatch;
+    const char *bytes = reinterpret_cast<const char *>(&header);
+    batch.insert(batch.end(), bytes, bytes + sizeof(header));
+    batch.insert(batch.end(), payload.begin(), payload.end());
+    if (batch.size() >= JOURNAL_BATCH_BYTES) writeJournalBatch();
+}
 
-    cout << "Enter who paid (user): ";
-    getline(cin, newExpense.paidBy);
+// Snapshots are only taken once an operation's records are all written. A
+// snapshot between a batch's changes and the rest of its records would
+// already hold the whole batch, and replay would apply the tail again. An
+// ingest takes a single snapshot when it is done instead.
+void snapshotIfDue() {
+    if (ledger->recordsSinceSnapshot >= SNAPSHOT_INTERVAL && !ledger->batchingJournal) writeSnapshot();
+}
 
-    int userCount;
-    cout << "How many users are splitting the expense? ";
-    cin >> userCount;
-    cin.ignore();
+template <typename T>
+void appendBytes(vector<char> &out, const T *data, size_t count) {
+    const char *bytes = reinterpret_cast<const char *>(data);
+    out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+
+void journalUser(UserId user) {
+    if (ledger->journalFile == nullptr) return;
+    string_view name = ledger->users.name(user);
+    static thread_local vector<char> payload;
+    payload.assign(name.begin(), name.end());
+    writeJournalRecord(JOURNAL_USER, payload);
+    snapshotIfDue();
+}
 
-    newExpense.splitAmong.push_back(newExpense.paidBy);
-    newExpense.amountOwed.push_back(0.0f); // Payer owes nothing
+void journalExpense(size_t row) {
+    const ExpenseStore &expenses = ledger->expenses;
+    if (ledger->journalFile == nullptr) return;
+    uint64_t first = expenses.participantOffsets[row];
+    uint32_t count = static_cast<uint32_t>(expenses.participantOffsets[row + 1] - first);
+    string scratch;
+    string_view description = expenses.description(row, scratch);
 
-    for (int i = 0; i < userCount; i++) {
-        string name;
-        cout << "Enter user " << i + 1 << " name: ";
-        getline(cin, name);
-        newExpense.splitAmong.push_back(name);
+    JournalExpense fixed = {expenses.amounts[row], expenses.times[row], expenses.payers[row], count,
+                            static_cast<uint32_t>(description.size()), 0};
+    static thread_local vector<char> payload;
+    payload.clear();
+    appendBytes(payload, &fixed, 1);
+    for (uint64_t slot = first; slot < first + count; ++slot) appendBytes(payload, &expenses.participants[slot], 1);
+    for (uint64_t slot = first; slot < first + count; ++slot) appendBytes(payload, &expenses.owed[slot], 1);
+    appendBytes(payload, description.data(), description.size());
+    writeJournalRecord(JOURNAL_EXPENSE, payload);
+    snapshotIfDue();
+}
+
+void journalSettlements(const Settlement *batch, size_t count) {
+    if (ledger->journalFile == nullptr) return;
+    static thread_local vector<char> payload;
+    for (size_t i = 0; i < count; ++i) {
+        payload.clear();
+        appendBytes(payload, &batch[i], 1);
+        writeJournalRecord(JOURNAL_SETTLEMENT, payload);
     }
+    snapshotIfDue();
+}
 
-    float amountPerUser = newExpense.amount / (userCount + 1);
-    for (int i = 0; i < userCount; i++) {
-        newExpense.amountOwed.push_back(amountPerUser);
+void journalSettlement(const Settlement &s) {
+    journalSettlements(&s, 1);
+}
+
+// The pass is deterministic, so replaying it on the same graph repeats it
+void journalCycleCancellation() {
+    if (ledger->journalFile == nullptr) return;
+    writeJournalRecord(JOURNAL_CYCLES, vector<char>());
+    snapshotIfDue();
+}
+
+// Creates an empty journal, replacing any existing one
+FILE *startJournal(const string &path) {
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        cerr << "Cannot open " << path << ": " << strerror(errno) << "\n";
+        return nullptr;
     }
+    fwrite(JOURNAL_MAGIC, 1, sizeof(JOURNAL_MAGIC), file);
+    return file;
+}
 
-    expenses.push_back(newExpense);
+void flushJournal() {
+    if (ledger->journalFile == nullptr) return;
+    writeJournalBatch();
+    fflush(ledger->journalFile);
+}
 
-    // Update balances
-    userBalances[newExpense.paidBy] += newExpense.amount;
-    for (int i = 0; i < userCount; i++) {
-        const string &debtor = newExpense.splitAmong[i + 1];
-        userBalances[debtor] -= amountPerUser;
-        addDebtToGraph(newExpense.paidBy, debtor, amountPerUser);
+// Maps a whole file copy-on-write; returns false if it is missing or empty
+bool mapFile(const string &path, const char *&data, size_t &size) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    bool ok = fstat(fd, &info) == 0 && info.st_size > 0;
+    if (ok) {
+        size = static_cast<size_t>(info.st_size);
+        // Private, so the writes made to a loaded edge index stay in this
+        // process and never reach the file
+        void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ok = mapping != MAP_FAILED;
+        if (ok) data = static_cast<const char *>(mapping);
     }
+    close(fd);
+    return ok;
+}
 
-    cout << "Expense added successfully.\n";
+void writePadding(FILE *file, size_t bytes) {
+    static const char padding[8] = {};
+    fwrite(padding, 1, (8 - bytes % 8) % 8, file);
 }
 
-// ------------------------------
-// Print Expenses
-// ------------------------------
-void printExpenses() {
-    if (expenses.empty()) {
-        cout << "No expenses recorded.\n";
-        return;
+// Writes count elements and pads the file to the next 8-byte boundary
+template <typename T>
+void writeSection(FILE *file, const T *data, size_t count) {
+    size_t bytes = count * sizeof(T);
+    if (bytes > 0) fwrite(data, 1, bytes, file);
+    writePadding(file, bytes);
+}
+
+// The same for a chunked column, one write per chunk
+template <typename T>
+void writeSection(FILE *file, const CowColumn<T> &column) {
+    column.forEachSpan([&](const T *data, size_t count) { fwrite(data, sizeof(T), count, file); });
+    writePadding(file, column.size() * sizeof(T));
+}
+
+bool writeSnapshot() {
+    const UserTable &users = ledger->users;
+    const ExpenseStore &expenses = ledger->expenses;
+    const CowColumn<Money> &userBalances = ledger->userBalances;
+    const CowColumn<GraphEdge> &debtGraph = ledger->debtGraph;
+    const vector<Settlement> &settledLog = ledger->settledLog;
+    if (ledger->dataPrefix.empty() || ledger->recordsSinceSnapshot == 0) return true;
+    flushJournal();
+
+    SnapshotHeader header = {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.sequence = ledger->journalSequence;
+    header.userCount = users.size();
+    header.expenseCount = expenses.size();
+    header.edgeCount = debtGraph.size();
+    header.settlementCount = settledLog.size();
+    header.edgeSlots = ledger->debtEdgeIndex.capacity;
+
+    vector<uint64_t> nameOffsets(1, 0);
+    for (UserId id = 0; id < users.size(); ++id) nameOffsets.push_back(nameOffsets.back() + users.name(id).size());
+    header.nameBytes = nameOffsets.back();
+
+    header.participantCount = expenses.participants.size();
+    header.descriptionBytes = expenses.descriptions.size();
+
+    string tempPath = ledger->dataPrefix + ".snapshot.tmp";
+    FILE *file = fopen(tempPath.c_str(), "wb");
+    if (file == nullptr) {
+        cerr << "Cannot write " << tempPath << ": " << strerror(errno) << "\n";
+        return false;
     }
 
-    for (const auto &exp : expenses) {
-        cout << "\n--- Expense: " << exp.description << " ---\n";
-        cout << "Amount: " << fixed << setprecision(2) << exp.amount
-             << " paid by " << exp.paidBy << "\n";
-        cout << "Split among:\n";
-        for (size_t i = 0; i < exp.splitAmong.size(); ++i) {
-            cout << "\t" << exp.splitAmong[i]
-                 << " owes " << exp.amountOwed[i] << "\n";
+    writeSection(file, &header, 1);
+    writeSection(file, nameOffsets.data(), nameOffsets.size());
+    users.names.forEachSpan([&](const string_view *names, size_t count) {
+        for (size_t i = 0; i < count; ++i) fwrite(names[i].data(), 1, names[i].size(), file);
+    });
+    writePadding(file, header.nameBytes);
+    writeSection(file, userBalances);
+    writeSection(file, expenses.amounts);
+    writeSection(file, expenses.payers);
+    writeSection(file, expenses.times);
+    writeSection(file, expenses.participantOffsets);
+    writeSection(file, expenses.descriptionOffsets);
+    writeSection(file, expenses.participants);
+    writeSection(file, expenses.owed);
+    writeSection(file, expenses.shares);
+    writeSection(file, expenses.slotRows);
+    writeSection(file, expenses.descriptions);
+    writeSection(file, debtGraph);
+    writeSection(file, settledLog.data(), settledLog.size());
+    for (const vector<vector<uint64_t>> *lists : {&ledger->userSlots, &ledger->paidRows}) {
+        vector<uint64_t> offsets(1, 0);
+        for (const vector<uint64_t> &list : *lists) offsets.push_back(offsets.back() + list.size());
+        writeSection(file, offsets.data(), offsets.size());
+        for (const vector<uint64_t> &list : *lists) {
+            if (!list.empty()) fwrite(list.data(), sizeof(uint64_t), list.size(), file);
         }
     }
+    writeSection(file, ledger->debtEdgeIndex.keys, header.edgeSlots);
+    writeSection(file, ledger->debtEdgeIndex.values, header.edgeSlots);
+
+    bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    string snapshotPath = ledger->dataPrefix + ".snapshot";
+    if (!ok || rename(tempPath.c_str(), snapshotPath.c_str()) != 0) {
+        cerr << "Cannot write " << snapshotPath << ": " << strerror(errno) << "\n";
+        return false;
+    }
+
+    // Everything journaled so far is in the snapshot; start a fresh journal
+    if (ledger->journalFile != nullptr) {
+        fclose(ledger->journalFile);
+        ledger->journalFile = startJournal(ledger->dataPrefix + ".journal");
+    }
+    ledger->recordsSinceSnapshot = 0;
+    return true;
 }
 
-// ------------------------------
-// Add Settlement (enqueue)
-// ------------------------------
-void enqueueSettlement() {
-    Settlement s;
-    cout << "\nEnter the user who will pay: ";
-    getline(cin, s.fromUser);
-    cout << "Enter the user to receive the payment: ";
-    getline(cin, s.toUser);
-    cout << "Enter the amount to settle: ";
-    cin >> s.amount;
-    cin.ignore();
+// Reads consecutive sections out of a mapped snapshot with bounds checks
+struct SnapshotReader {
+    const char *data;
+    size_t size;
+    size_t offset = 0;
 
-    settlements.push(s);
-    cout << "Settlement added to queue.\n";
+    template <typename T>
+    const T *section(uint64_t count) {
+        size_t bytes = count * sizeof(T);
+        if (count > size / sizeof(T) || bytes > size - offset) return nullptr;
+        const T *result = reinterpret_cast<const T *>(data + offset);
+        offset += (bytes + 7) & ~size_t(7);
+        if (offset > size) offset = size;
+        return result;
+    }
+};
+
+// Offsets start at 0, never decrease and end exactly at the section size
+bool validOffsets(const uint64_t *offsets, uint64_t count, uint64_t end) {
+    if (offsets[0] != 0 || offsets[count] != end) return false;
+    for (uint64_t i = 0; i < count; ++i)
+        if (offsets[i] > offsets[i + 1]) return false;
+    return true;
 }
 
-// ------------------------------
-// Process Settlement (dequeue)
-// ------------------------------
-void processSettlement() {
-    if (settlements.empty()) {
-        cout << "No settlements to process.\n";
-        return;
+bool validUserIds(const UserId *ids, uint64_t count, uint64_t userCount) {
+    for (uint64_t i = 0; i < count; ++i)
+        if (ids[i] >= userCount) return false;
+    return true;
+}
+
+bool validSlotRows(const uint64_t *participantOffsets, const uint64_t *slotRows, uint64_t expenseCount) {
+    for (uint64_t row = 0; row < expenseCount; ++row) {
+        for (uint64_t slot = participantOffsets[row]; slot < participantOffsets[row + 1]; ++slot)
+            if (slotRows[slot] != row) return false;
     }
+    return true;
+}
+
+// Each user's list holds positions owned by that user in increasing order;
+// with valid offsets ending at count, every position is then listed once
+bool validUserLists(const uint64_t *offsets, const uint64_t *lists, const UserId *owners, uint64_t count,
+                    uint64_t userCount) {
+    for (uint64_t id = 0; id < userCount; ++id) {
+        for (uint64_t i = offsets[id]; i < offsets[id + 1]; ++i) {
+            if (lists[i] >= count || owners[lists[i]] != id) return false;
+            if (i > offsets[id] && lists[i] <= lists[i - 1]) return false;
+        }
+    }
+    return true;
+}
 
-    Settlement s = settlements.front();
-    settlements.pop();
+// Returns false if the snapshot is unreadable or inconsistent, leaving the
+// ledger untouched so the caller can rebuild it from the journal alone
+bool loadSnapshot(const string &path) {
+    ExpenseStore &expenses = ledger->expenses;
+    CowColumn<GraphEdge> &debtGraph = ledger->debtGraph;
+    const char *data;
+    size_t size;
+    if (!mapFile(path, data, size)) return true; // No snapshot yet
 
-    cout << "Settling: " << s.fromUser << " pays " << s.toUser
-         << " " << fixed << setprecision(2) << s.amount << "\n";
+    SnapshotReader reader = {data, size};
+    const SnapshotHeader *header = reader.section<SnapshotHeader>(1);
+    bool ok = header != nullptr && memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0;
 
-    // Update balances
-    userBalances[s.fromUser] += s.amount;
-    userBalances[s.toUser] -= s.amount;
+    const uint64_t *nameOffsets = nullptr, *participantOffsets = nullptr, *descriptionOffsets = nullptr;
+    const char *names = nullptr, *descriptions = nullptr;
+    const Money *balances = nullptr, *amounts = nullptr, *owed = nullptr, *shares = nullptr;
+    const uint64_t *slotRows = nullptr;
+    const UserId *payers = nullptr, *participants = nullptr;
+    const Timestamp *times = nullptr;
+    const GraphEdge *edges = nullptr;
+    const Settlement *settled = nullptr;
+    const uint64_t *slotOffsets = nullptr, *slotLists = nullptr, *paidOffsets = nullptr, *paidLists = nullptr;
+    const uint64_t *edgeKeys = nullptr;
+    const uint32_t *edgePositions = nullptr;
+    if (ok) {
+        nameOffsets = reader.section<uint64_t>(header->userCount + 1);
+        names = reader.section<char>(header->nameBytes);
+        balances = reader.section<Money>(header->userCount);
+        amounts = reader.section<Money>(header->expenseCount);
+        payers = reader.section<UserId>(header->expenseCount);
+        times = reader.section<Timestamp>(header->expenseCount);
+        participantOffsets = reader.section<uint64_t>(header->expenseCount + 1);
+        descriptionOffsets = reader.section<uint64_t>(header->expenseCount + 1);
+        participants = reader.section<UserId>(header->participantCount);
+        owed = reader.section<Money>(header->participantCount);
+        shares = reader.section<Money>(header->participantCount);
+        slotRows = reader.section<uint64_t>(header->participantCount);
+        descriptions = reader.section<char>(header->descriptionBytes);
+        edges = reader.section<GraphEdge>(header->edgeCount);
+        settled = reader.section<Settlement>(header->settlementCount);
+        slotOffsets = reader.section<uint64_t>(header->userCount + 1);
+        slotLists = reader.section<uint64_t>(header->participantCount);
+        paidOffsets = reader.section<uint64_t>(header->userCount + 1);
+        paidLists = reader.section<uint64_t>(header->expenseCount);
+        edgeKeys = reader.section<uint64_t>(header->edgeSlots);
+        edgePositions = reader.section<uint32_t>(header->edgeSlots);
+        ok = nameOffsets && names && balances && amounts && payers && times && participantOffsets &&
+             descriptionOffsets && participants && owed && shares && slotRows && descriptions && edges && settled &&
+             slotOffsets && slotLists && paidOffsets && paidLists && edgeKeys && edgePositions;
+    }
 
-    updateExpenseAfterSettlement(s.fromUser, s.toUser, s.amount);
+    // Every id and offset is checked before anything is indexed by it
+    UserTable users;
+    if (ok) {
+        uint64_t userCount = header->userCount;
+        ok = userCount < UINT32_MAX && header->edgeCount < UINT32_MAX &&
+             validOffsets(nameOffsets, userCount, header->nameBytes) &&
+             validOffsets(participantOffsets, header->expenseCount, header->participantCount) &&
+             validOffsets(descriptionOffsets, header->expenseCount, header->descriptionBytes) &&
+             validUserIds(payers, header->expenseCount, userCount) &&
+             validUserIds(participants, header->participantCount, userCount) &&
+             validSlotRows(participantOffsets, slotRows, header->expenseCount) &&
+             validOffsets(slotOffsets, userCount, header->participantCount) &&
+             validOffsets(paidOffsets, userCount, header->expenseCount) &&
+             validUserLists(slotOffsets, slotLists, participants, header->participantCount, userCount) &&
+             validUserLists(paidOffsets, paidLists, payers, header->expenseCount, userCount);
+        for (uint64_t i = 0; ok && i < header->edgeCount; ++i)
+            ok = edges[i].fromUser < userCount && edges[i].toUser < userCount;
+        for (uint64_t i = 0; ok && i < header->settlementCount; ++i)
+            ok = settled[i].fromUser < userCount && settled[i].toUser < userCount;
+
+        // The edge index table is a power of two, at most half full, and
+        // holds every edge's position exactly once, under that edge's key
+        uint64_t slots = header->edgeSlots, filled = 0;
+        ok = ok && (slots & (slots - 1)) == 0 && header->edgeCount * 2 <= slots;
+        vector<bool> indexed(ok ? header->edgeCount : 0);
+        for (uint64_t i = 0; ok && i < slots; ++i) {
+            if (edgeKeys[i] == EdgeIndex::EMPTY) continue;
+            uint32_t position = edgePositions[i];
+            ok = position < header->edgeCount && !indexed[position] &&
+                 edgeKeys[i] == EdgeIndex::key(edges[position].fromUser, edges[position].toUser);
+            if (ok) indexed[position] = true;
+            filled++;
+        }
+        ok = ok && filled == header->edgeCount;
+
+        // Interned aside, so a repeated name (which would intern to an
+        // earlier id and shift the rest) leaves the ledger untouched
+        for (uint64_t id = 0; ok && id < userCount; ++id)
+            ok = users.intern(string_view(names + nameOffsets[id], nameOffsets[id + 1] - nameOffsets[id])) == id;
+    }
+    if (!ok) {
+        cerr << path << " is not a valid snapshot\n";
+        munmap(const_cast<char *>(data), size);
+        return false;
+    }
+
+    ledger->users = move(users);
+    ledger->paidRows.resize(header->userCount);
+    for (UserId id = 0; id < header->userCount; ++id) {
+        ledger->addUser(id);
+        ledger->changeBalance(id, balances[id]);
+    }
+
+    // The columns are stored exactly as ExpenseStore keeps them, so they
+    // share the mapping instead of being copied out of it; the mapping goes
+    // once the last column or view chunk on it does
+    shared_ptr<const void> mapping(data, [size](const void *p) { munmap(const_cast<void *>(p), size); });
+    expenses.amounts.assignShared(mapping, amounts, header->expenseCount);
+    expenses.payers.assignShared(mapping, payers, header->expenseCount);
+    expenses.times.assignShared(mapping, times, header->expenseCount);
+    expenses.participantOffsets.assignShared(mapping, participantOffsets, header->expenseCount + 1);
+    expenses.descriptionOffsets.assignShared(mapping, descriptionOffsets, header->expenseCount + 1);
+    expenses.participants.assignShared(mapping, participants, header->participantCount);
+    expenses.owed.assignShared(mapping, owed, header->participantCount);
+    expenses.shares.assignShared(mapping, shares, header->participantCount);
+    expenses.slotRows.assignShared(mapping, slotRows, header->participantCount);
+    expenses.descriptions.assignShared(mapping, descriptions, header->descriptionBytes);
+
+    for (UserId id = 0; id < header->userCount; ++id) {
+        ledger->userSlots[id].assign(slotLists + slotOffsets[id], slotLists + slotOffsets[id + 1]);
+        ledger->paidRows[id].assign(paidLists + paidOffsets[id], paidLists + paidOffsets[id + 1]);
+    }
+
+    debtGraph.assignShared(mapping, edges, header->edgeCount);
+    ledger->debtEdgeIndex.assignShared(mapping, const_cast<uint64_t *>(edgeKeys), const_cast<uint32_t *>(edgePositions),
+                                       header->edgeSlots, header->edgeCount);
+    ledger->settledLog.assign(settled, settled + header->settlementCount);
+
+    ledger->journalSequence = header->sequence;
+    return true;
 }
 
-// ------------------------------
-// Print All Settlements
-// ------------------------------
-void printSettlements() {
-    if (settlements.empty()) {
-        cout << "No settlements in the queue.\n";
-        return;
+// Replays journal records newer than the snapshot. A torn record at the
+// end (from a crash mid-write) is dropped.
+bool replayJournal(const string &path, size_t &validBytes) {
+    const char *data;
+    size_t size;
+    validBytes = 0;
+    if (!mapFile(path, data, size)) return true; // Empty or missing journal
+    if (size < sizeof(JOURNAL_MAGIC) || memcmp(data, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0) {
+        cerr << path << " is not a valid journal\n";
+        munmap(const_cast<char *>(data), size);
+        return false;
     }
 
-    queue<Settlement> temp = settlements;
-    while (!temp.empty()) {
-        Settlement s = temp.front();
-        cout << s.fromUser << " pays " << s.toUser
-             << " " << fixed << setprecision(2) << s.amount << "\n";
-        temp.pop();
+    size_t offset = sizeof(JOURNAL_MAGIC);
+    while (size - offset >= sizeof(JournalRecordHeader)) {
+        JournalRecordHeader header;
+        memcpy(&header, data + offset, sizeof(header));
+        if (header.size > size - offset - sizeof(header)) break;
+        const char *payload = data + offset + sizeof(header);
+
+        if (header.sequence > ledger->journalSequence) {
+            // Records run on from the snapshot with no gap
+            if (header.sequence != ledger->journalSequence + 1) {
+                cerr << path << ": records " << ledger->journalSequence + 1 << " to " << header.sequence - 1
+                     << " are missing\n";
+                munmap(const_cast<char *>(data), size);
+                return false;
+            }
+            if (header.type == JOURNAL_USER) {
+                internUser(string_view(payload, header.size));
+            } else if (header.type == JOURNAL_EXPENSE && header.size >= sizeof(JournalExpense)) {
+                JournalExpense fixed;
+                memcpy(&fixed, payload, sizeof(fixed));
+                const char *cursor = payload + sizeof(fixed);
+                if (header.size != sizeof(fixed) + fixed.descriptionSize +
+                                   static_cast<size_t>(fixed.participantCount) * (sizeof(UserId) + sizeof(Money))) {
+                    cerr << path << ": corrupt expense record " << header.sequence << "\n";
+                    munmap(const_cast<char *>(data), size);
+                    return false;
+                }
+
+                // The payload is only byte-aligned, so copy the arrays out
+                vector<UserId> participants(fixed.participantCount);
+                vector<Money> owed(fixed.participantCount);
+                memcpy(participants.data(), cursor, fixed.participantCount * sizeof(UserId));
+                cursor += fixed.participantCount * sizeof(UserId);
+                memcpy(owed.data(), cursor, fixed.participantCount * sizeof(Money));
+                cursor += fixed.participantCount * sizeof(Money);
+                if (fixed.participantCount == 0 || fixed.paidBy >= ledger->users.size() ||
+                    !validUserIds(participants.data(), fixed.participantCount, ledger->users.size())) {
+                    cerr << path << ": corrupt expense record " << header.sequence << "\n";
+                    munmap(const_cast<char *>(data), size);
+                    return false;
+                }
+                appendExpense(string_view(cursor, fixed.descriptionSize), fixed.amount, fixed.paidBy, fixed.time,
+                              participants.data(), owed.data(), fixed.participantCount);
+            } else if (header.type == JOURNAL_SETTLEMENT && header.size == sizeof(Settlement)) {
+                Settlement s;
+                memcpy(&s, payload, sizeof(s));
+                if (s.fromUser >= ledger->users.size() || s.toUser >= ledger->users.size()) {
+                    cerr << path << ": corrupt settlement record " << header.sequence << "\n";
+                    munmap(const_cast<char *>(data), size);
+                    return false;
+                }
+                applySettlement(s);
+            } else if (header.type == JOURNAL_CYCLES && header.size == 0) {
+                cancelDebtCycles();
+            } else {
+                cerr << path << ": unknown journal record type " << header.type << "\n";
+                munmap(const_cast<char *>(data), size);
+                return false;
+            }
+            ledger->journalSequence = header.sequence;
+            ledger->recordsSinceSnapshot++;
+        }
+        offset += sizeof(header) + header.size;
     }
+
+    validBytes = offset;
+    munmap(const_cast<char *>(data), size);
+    return true;
 }
 
-// ------------------------------
-// Update Expenses After Settlement
-// ------------------------------
-void updateExpenseAfterSettlement(const string &fromUser, const string &toUser, float amount) {
-    for (auto &exp : expenses) {
-        for (size_t i = 0; i < exp.splitAmong.size(); ++i) {
-            if (exp.splitAmong[i] == fromUser)
-                exp.amountOwed[i] -= amount;
-            if (exp.splitAmong[i] == toUser)
-                exp.amountOwed[i] += amount;
+bool openDataStore(const string &prefix) {
+    string journalPath = prefix + ".journal";
+    size_t validBytes;
+    bool snapshotLoaded = loadSnapshot(prefix + ".snapshot");
+    if (!snapshotLoaded) cerr << "Rebuilding " << prefix << " from its journal alone\n";
+    if (!replayJournal(journalPath, validBytes)) return false;
+
+    // The journal restarts after each snapshot, so without the snapshot it
+    // only holds the whole history if it still begins at record 1. Stop
+    // before a later snapshot could overwrite the damaged one.
+    if (!snapshotLoaded && ledger->journalSequence == 0) {
+        cerr << "Cannot rebuild " << prefix << ": the journal does not hold the full history\n";
+        return false;
+    }
+
+    if (validBytes == 0) {
+        ledger->journalFile = startJournal(journalPath);
+    } else {
+        // Drop any torn tail before appending after it
+        if (truncate(journalPath.c_str(), static_cast<off_t>(validBytes)) != 0) {
+            cerr << "Cannot truncate " << journalPath << ": " << strerror(errno) << "\n";
+            return false;
         }
+        ledger->journalFile = fopen(journalPath.c_str(), "ab");
+        if (ledger->journalFile == nullptr)
+            cerr << "Cannot open " << journalPath << ": " << strerror(errno) << "\n";
     }
+    if (ledger->journalFile == nullptr) return false;
+    ledger->dataPrefix = prefix;
+    return true;
 }
 
-// ------------------------------
-// Add Debt To Graph
-// ------------------------------
-void addDebtToGraph(const string &fromUser, const string &toUser, float amount) {
-    debtGraph[fromUser].push_back({toUser, amount});
+bool writeAllSnapshots() {
+    bool ok = true;
+    for (Ledger *each : ledgers.all()) {
+        LedgerScope scope(*each);
+        lock_guard<mutex> lock(each->lock);
+        ok = writeSnapshot() && ok;
+    }
+    return ok;
 }
 
 // ------------------------------
-// Print Graph
+// Groups
 // ------------------------------
-void printGraph() {
-    if (debtGraph.empty()) {
-        cout << "No debts recorded.\n";
-        return;
+// Group names become part of file names, so they are kept to a safe set
+bool validGroupName(string_view name) {
+    if (name.empty() || name.size() > 64 || name[0] == '.') return false;
+    for (char c : name) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_' && c != '.') return false;
     }
+    return true;
+}
 
-    for (const auto &node : debtGraph) {
-        cout << node.first << " owes:\n";
-        for (const auto &edge : node.second) {
-            cout << "  - " << edge.toUser << ": " << fixed << setprecision(2)
-                 << edge.amount << "\n";
-        }
+// Finds or creates a group's ledger. With --data, a new group's ledger is
+// loaded from <prefix>.snapshot/.journal for the default group and from
+// <prefix>.<group>.snapshot/.journal for the others. Returns nullptr if the
+// data store cannot be opened.
+Ledger *openGroup(const string &name) {
+    Ledger &group = ledgers.get(name);
+    call_once(group.opened, [&]() {
+        if (dataRoot.empty()) return;
+        LedgerScope scope(group);
+        lock_guard<mutex> lock(group.lock);
+        group.openFailed = !openDataStore(name == DEFAULT_GROUP ? dataRoot : dataRoot + "." + name);
+    });
+    return group.openFailed ? nullptr : &group;
+}
+
+void switchGroup() {
+    string name = readString("Enter group name: ");
+    if (!validGroupName(name)) {
+        cout << "Group names use letters, digits, '-', '_' and '.'.\n";
+        return;
     }
+    Ledger *group = openGroup(name);
+    if (group == nullptr) return;
+    ledger = group;
+    cout << "Switched to group " << name << " (" << ledger->users.size() << " users, "
+         << ledger->expenses.size() << " expenses).\n";
 }
 
 // ------------------------------
-// Print Balances
+// Server: line protocol over a Unix socket
 // ------------------------------
-void printBalances() {
-    if (userBalances.empty()) {
-        cout << "No balances recorded.\n";
-        return;
+// With --serve <path> the tracker listens on a Unix domain socket instead of
+// running the menu. Requests are lines, split on tabs if the line has one
+// and on commas otherwise; each gets exactly one response line, "OK ..." or
+// "ERR <reason>", except that "OK <n>" for balances is followed by n lines.
+//   expense,...  expense:<split>,...    As in ingest files   -> OK <row>
+//   settle,<from>,<to>,<amount>         Queue a settlement   -> OK <queued>
+//                                       or, with --background, submit it -> OK submitted
+//                                       once the worker has journaled it
+//   process                             Apply the oldest     -> OK <from>,<to>,<amount>
+//   process-all                         Apply them all       -> OK <count>
+//   balance,<user>                      -> OK <balance>
+//   balances                            -> OK <n>, then <user>,<balance> lines by name
+//   group,<name>                        Switch this connection's group (initially --group) -> OK
+//   quit                                Close after the responses so far
+// Records may start with a timestamp, as in ingest files. Clients may send
+// any number of requests without waiting: everything that has arrived is
+// answered under one lock of the ledger and written back in one go. The
+// loop is single-threaded and driven by epoll; SIGINT or SIGTERM stops it,
+// writing snapshots as Exit does. With --background, settlements for the
+// --group ledger are handed to the background processor instead of the
+// queue that process and process-all apply; their replies, and any after
+// them on the same connection, are held until the worker has journaled
+// them.
+
+static constexpr size_t SERVER_MAX_LINE = 1 << 20;
+
+struct ServerConnection {
+    int fd;
+    Ledger *group;
+    string in, out;
+    size_t sent = 0;                               // Bytes of out already written
+    bool quit = false;                             // Close once out is written
+    uint32_t events = 0;                           // Events registered with epoll
+    vector<Settlement> submitted;                  // For the worker, once the lock is released
+    size_t heldFrom = string::npos;                // out from here waits for the worker
+    uint64_t heldUntil = 0;                        // settlementsJournaled value that releases it
+};
+
+// Settlements for a group the background worker is running on are left in
+// submitted, to be handed to the worker once the ledger lock is released
+void serveRequest(string_view line, Ledger *&group, string &out, bool &quit, vector<Settlement> &submitted) {
+    static thread_local vector<string_view> fields;
+    OperationTimer timer(Operation::ServeRequest);
+    splitFields(line.data(), line.data() + line.size(), line.find('\t') != string_view::npos ? '\t' : ',', fields);
+
+    Timestamp recordTime = time(nullptr);
+    if (fields.size() > 1 && fields[0].substr(0, 7) != "expense" && fields[0] != "settle" &&
+        parseTimestamp(fields[0], recordTime, false))
+        fields.erase(fields.begin());
+
+    string_view command = fields[0];
+    Settlement settlement;
+    string error;
+    if (command.substr(0, 7) == "expense") {
+        if (recordExpenseFields(fields, recordTime, error))
+            out += "OK " + to_string(ledger->expenses.size() - 1) + "\n";
+        else
+            out += "ERR " + (error.empty() ? string("malformed expense") : error) + "\n";
+    } else if (command == "settle") {
+        if (!parseSettlementFields(fields, recordTime, settlement)) {
+            out += "ERR malformed settlement\n";
+        } else if (settlementWorkerRunning.load(memory_order_acquire) && settlementWorkerLedger == ledger) {
+            submitted.push_back(settlement);
+            out += "OK submitted\n";
+        } else {
+            ledger->settlements.push(settlement);
+            out += "OK " + to_string(ledger->settlements.size()) + "\n";
+        }
+    } else if (command == "process" && fields.size() == 1) {
+        if (ledger->settlements.empty()) {
+            out += "ERR no settlements to process\n";
+            return;
+        }
+        settlement = ledger->settlements.front();
+        ledger->settlements.pop();
+        {
+            OperationTimer processTimer(Operation::ProcessSettlement);
+            applySettlement(settlement);
+        }
+        out += "OK " + string(ledger->users.name(settlement.fromUser)) + "," +
+               string(ledger->users.name(settlement.toUser)) + "," + formatMoney(settlement.amount) + "\n";
+    } else if (command == "process-all" && fields.size() == 1) {
+        vector<Settlement> batch;
+        batch.reserve(ledger->settlements.size());
+        while (!ledger->settlements.empty()) {
+            batch.push_back(ledger->settlements.front());
+            ledger->settlements.pop();
+        }
+        if (!batch.empty()) applySettlements(batch.data(), batch.size());
+        out += "OK " + to_string(batch.size()) + "\n";
+    } else if (command == "balance" && fields.size() == 2) {
+        UserId user;
+        if (ledger->users.find(fields[1], user))
+            out += "OK " + formatMoney(ledger->userBalances[user]) + "\n";
+        else
+            out += "ERR unknown user\n";
+    } else if (command == "balances" && fields.size() == 1) {
+        const vector<UserId> &order = usersByName();
+        out += "OK " + to_string(order.size()) + "\n";
+        for (UserId user : order) {
+            out += ledger->users.name(user);
+            out += ",";
+            out += formatMoney(ledger->userBalances[user]);
+            out += "\n";
+        }
+    } else if (command == "group" && fields.size() == 2) {
+        Ledger *selected = validGroupName(fields[1]) ? openGroup(string(fields[1])) : nullptr;
+        if (selected == nullptr) {
+            out += "ERR cannot open group\n";
+            return;
+        }
+        group = selected;
+        out += "OK\n";
+    } else if (command == "quit" && fields.size() == 1) {
+        quit = true;
+    } else {
+        out += "ERR unknown request\n";
+    }
+}
+
+#if defined(__linux__)
+sigset_t stopSignalSet() {
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    return stopSignals;
+}
+
+// Called by main before it starts any thread, so that every thread inherits
+// the mask and the stop signals reach only serve()'s signalfd
+void blockStopSignals() {
+    sigset_t stopSignals = stopSignalSet();
+    pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+}
+
+bool serve(const char *path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        cerr << "Socket path too long: " << path << "\n";
+        return false;
+    }
+    strcpy(address.sun_path, path);
+
+    // A socket left behind by an earlier run is replaced; anything else is not
+    struct stat info;
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) unlink(path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        cerr << "Cannot listen on " << path << ": " << strerror(errno) << "\n";
+        if (listener >= 0) close(listener);
+        return false;
+    }
+
+    // Stop signals, blocked since main started, arrive as readable events on
+    // the loop
+    sigset_t stopSignals = stopSignalSet();
+    signal(SIGPIPE, SIG_IGN);
+    int signals = signalfd(-1, &stopSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    int poller = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;                      // The listener
+    epoll_ctl(poller, EPOLL_CTL_ADD, listener, &event);
+    event.data.ptr = &signals;
+    epoll_ctl(poller, EPOLL_CTL_ADD, signals, &event);
+    if (settlementJournaledPipe[0] >= 0) {
+        event.data.ptr = settlementJournaledPipe;
+        epoll_ctl(poller, EPOLL_CTL_ADD, settlementJournaledPipe[0], &event);
     }
+    cout << "Serving on " << path << "\n" << flush;
 
-    cout << "\nUser Balances:\n";
-    for (const auto &pair : userBalances) {
-        cout << pair.first << ": " << fixed << setprecision(2)
-             << pair.second << "\n";
+    vector<ServerConnection *> holding;            // Connections with replies held for the worker
+
+    auto closeConnection = [&](ServerConnection *connection) {
+        holding.erase(remove(holding.begin(), holding.end(), connection), holding.end());
+        epoll_ctl(poller, EPOLL_CTL_DEL, connection->fd, nullptr);
+        close(connection->fd);
+        delete connection;
+    };
+
+    // Writes what it can, up to any replies held for the worker; false once
+    // the connection is finished with
+    auto flushConnection = [&](ServerConnection *connection) {
+        size_t ready = min(connection->out.size(), connection->heldFrom);
+        while (connection->sent < ready) {
+            ssize_t written = write(connection->fd, connection->out.data() + connection->sent,
+                                    ready - connection->sent);
+            if (written < 0 && errno == EINTR) continue;
+            if (written < 0 && errno == EAGAIN) break;
+            if (written < 0) return false;
+            connection->sent += written;
+        }
+        bool pending = connection->sent < connection->out.size();
+        if (!pending) {
+            connection->out.clear();
+            connection->sent = 0;
+            if (connection->quit) return false;
+        }
+        // Nothing more is read from a connection that is quitting
+        uint32_t wanted = (connection->quit ? 0u : uint32_t(EPOLLIN)) |
+                          (connection->sent < ready ? uint32_t(EPOLLOUT) : 0u);
+        if (wanted != connection->events) {
+            epoll_event update = {};
+            update.events = wanted;
+            update.data.ptr = connection;
+            epoll_ctl(poller, EPOLL_CTL_MOD, connection->fd, &update);
+            connection->events = wanted;
+        }
+        return true;
+    };
+
+    // Reads what is available, up to a little past SERVER_MAX_LINE, and
+    // answers every complete line in it; false once the connection is
+    // finished with. Anything left unread raises EPOLLIN again, so a client
+    // cannot grow in without bound, and a line still unfinished past the
+    // limit drops the connection.
+    auto readConnection = [&](ServerConnection *connection) {
+        char buffer[64 * 1024];
+        bool closed = false;
+        while (true) {
+            ssize_t received = read(connection->fd, buffer, sizeof(buffer));
+            if (received < 0 && errno == EINTR) continue;
+            if (received < 0 && errno == EAGAIN) break;
+            if (received <= 0) {
+                closed = true;
+                break;
+            }
+            connection->in.append(buffer, received);
+            if (connection->in.size() > SERVER_MAX_LINE) break;
+        }
+
+        // Everything that has arrived is answered under one lock of the
+        // ledger; a group switch ends the run and the rest is answered under
+        // the new group's lock
+        size_t start = 0, eol;
+        while (!connection->quit && connection->in.find('\n', start) != string::npos) {
+            LedgerScope scope(*connection->group);
+            lock_guard<mutex> lock(ledger->lock);
+            while (!connection->quit && (eol = connection->in.find('\n', start)) != string::npos) {
+                string_view line(connection->in.data() + start, eol - start);
+                if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+                start = eol + 1;
+                if (line.empty()) continue;
+
+                Ledger *group = connection->group;
+                size_t replyStart = connection->out.size(), submitted = connection->submitted.size();
+                serveRequest(line, group, connection->out, connection->quit, connection->submitted);
+                if (connection->submitted.size() > submitted)
+                    connection->heldFrom = min(connection->heldFrom, replyStart);
+                if (group != connection->group) {
+                    connection->group = group;
+                    break;
+                }
+            }
+            flushJournal();
+        }
+        // Only now that the lock is released: the worker needs it to drain
+        // a full ring
+        for (const Settlement &s : connection->submitted) connection->heldUntil = submitSettlement(s);
+        connection->submitted.clear();
+        if (connection->heldFrom != string::npos) {
+            if (settlementsJournaled.load(memory_order_acquire) >= connection->heldUntil)
+                connection->heldFrom = string::npos;
+            else if (find(holding.begin(), holding.end(), connection) == holding.end())
+                holding.push_back(connection);
+        }
+        connection->in.erase(0, start);
+        if (connection->in.size() > SERVER_MAX_LINE) {
+            connection->out += "ERR request too long\n";
+            connection->quit = true;
+        }
+
+        // A client that has stopped sending still gets its answers
+        if (closed) connection->quit = true;
+        return flushConnection(connection);
+    };
+
+    vector<epoll_event> events(64);
+    bool running = true;
+    while (running) {
+        int ready = epoll_wait(poller, events.data(), static_cast<int>(events.size()), -1);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) break;
+        for (int i = 0; i < ready; ++i) {
+            void *source = events[i].data.ptr;
+            if (source == &signals) {
+                running = false;
+            } else if (source == settlementJournaledPipe) {
+                // Release the replies whose settlements are now journaled
+                char wakeups[256];
+                while (read(settlementJournaledPipe[0], wakeups, sizeof(wakeups)) > 0) {}
+                uint64_t journaled = settlementsJournaled.load(memory_order_acquire);
+                auto released = partition(holding.begin(), holding.end(), [&](ServerConnection *connection) {
+                    return connection->heldUntil > journaled;
+                });
+                for (auto it = released; it != holding.end(); ++it) {
+                    // Written, and closed if it is done, on its own EPOLLOUT,
+                    // so no event later in this batch finds it deleted
+                    ServerConnection *connection = *it;
+                    connection->heldFrom = string::npos;
+                    epoll_event update = {};
+                    update.events = connection->events | EPOLLOUT;
+                    update.data.ptr = connection;
+                    epoll_ctl(poller, EPOLL_CTL_MOD, connection->fd, &update);
+                    connection->events = update.events;
+                }
+                holding.erase(released, holding.end());
+            } else if (source == nullptr) {
+                int client;
+                while ((client = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    ServerConnection *connection = new ServerConnection();
+                    connection->fd = client;
+                    connection->group = ledger;               // The --group selection
+                    connection->events = EPOLLIN;
+                    epoll_event add = {};
+                    add.events = EPOLLIN;
+                    add.data.ptr = connection;
+                    epoll_ctl(poller, EPOLL_CTL_ADD, client, &add);
+                }
+            } else {
+                ServerConnection *connection = static_cast<ServerConnection *>(source);
+                bool open = true;
+                if (events[i].events & EPOLLOUT) open = flushConnection(connection);
+                if (open && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) open = readConnection(connection);
+                if (!open) closeConnection(connection);
+            }
+        }
     }
+
+    cout << "Stopping server.\n";
+    close(poller);
+    close(signals);
+    close(listener);
+    unlink(path);
+    return true;
 }
+#else
+void blockStopSignals() {}
+
+bool serve(const char *path) {
+    cerr << "Cannot serve on " << path << ": server mode needs epoll (Linux)\n";
+    return false;
+}
+#endif
 
 // ------------------------------
 // Main Menu
 // ------------------------------
-int main() {
+// PRICETRACKER_NO_MAIN lets the benchmark harness include this file.
+#ifndef PRICETRACKER_NO_MAIN
+int main(int argc, char *argv[]) {
+    vector<const char *> ingestPaths;
+    const char *servePath = nullptr;
+    string groupName = DEFAULT_GROUP;
+    bool audit = false;
+    bool background = false;
+    bool cancelCycles = false;
+    size_t topCount = 0;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--ingest" && i + 1 < argc) ingestPaths.push_back(argv[++i]);
+        else if (arg == "--data" && i + 1 < argc) dataRoot = argv[++i];
+        else if (arg == "--serve" && i + 1 < argc) servePath = argv[++i];
+        else if (arg == "--group" && i + 1 < argc && validGroupName(argv[i + 1])) groupName = argv[++i];
+        else if (arg == "--audit") audit = true;
+        else if (arg == "--background") background = true;
+        else if (arg == "--stats") statsEnabled = true;
+        else if (arg == "--cancel-cycles") cancelCycles = true;
+        else if (arg == "--top" && i + 1 < argc) topCount = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--format" && i + 1 < argc && parseReportFormat(argv[i + 1], reportFormat)) ++i;
+        else {
+            cerr << "Usage: " << argv[0]
+                 << " [--data <prefix>] [--group <name>] [--ingest <file>]... [--audit] [--top <count>]\n"
+                 << "  [--background] [--format table|csv|json] [--stats] [--cancel-cycles] [--serve <socket>]\n"
+                 << "With several --ingest files, each is loaded in parallel into the group named\n"
+                 << "after the file. --serve answers requests on a Unix socket instead of the menu.\n";
+            return 1;
+        }
+    }
+
+    if (servePath != nullptr) blockStopSignals();
+    ledger = openGroup(groupName);
+    if (ledger == nullptr) return 1;
+
+    if (servePath != nullptr) {
+        if (background) startSettlementWorker();
+        bool ok = serve(servePath);
+        stopSettlementWorker();
+        if (statsEnabled) printOperationStats();
+        return writeAllSnapshots() && ok ? 0 : 1;
+    }
+
+    if (!ingestPaths.empty() || audit || topCount > 0 || cancelCycles) {
+        // One group per file when there are several, each filled on the pool
+        vector<Ledger *> targets;
+        for (const char *path : ingestPaths) {
+            string stem = path;
+            stem = stem.substr(stem.find_last_of('/') + 1);
+            stem = stem.substr(0, stem.find('.'));
+            if (ingestPaths.size() == 1) stem = groupName;
+            if (!validGroupName(stem)) {
+                cerr << "Cannot name a group after " << path << "\n";
+                return 1;
+            }
+            targets.push_back(openGroup(stem));
+            if (targets.back() == nullptr) return 1;
+        }
+
+        vector<IngestStats> stats(ingestPaths.size());
+        vector<char> ingested(ingestPaths.size(), 0);
+        {
+            ThreadPool pool(min<size_t>(ingestPaths.size(), max(1u, thread::hardware_concurrency())));
+            for (size_t i = 0; i < ingestPaths.size(); ++i) {
+                pool.submit([&, i]() {
+                    LedgerScope scope(*targets[i]);
+                    lock_guard<mutex> lock(ledger->lock);
+                    ingested[i] = ingestFile(ingestPaths[i], stats[i]);
+                });
+            }
+            pool.wait();
+        }
+
+        bool ok = true;
+        if (targets.empty()) targets.push_back(ledger);
+        for (size_t i = 0; i < targets.size(); ++i) {
+            LedgerScope scope(*targets[i]);
+            if (targets.size() > 1) cout << "\n=== Group: " << ledger->name << " ===\n";
+            if (i < ingestPaths.size()) {
+                ok = ingested[i] && ok;
+                if (!ingested[i]) continue;
+                printIngestSummary(ingestPaths[i], stats[i]);
+                printBalances();
+            }
+            if (cancelCycles) printCycleStats(cancelDebtCycles());
+            if (audit) ok = auditBalances() && ok;
+            if (topCount > 0) printTopBalances(topCount);
+        }
+        if (statsEnabled) printOperationStats();
+        return writeAllSnapshots() && ok ? 0 : 1;
+    }
+
+    if (background) startSettlementWorker();
     int choice;
 
     while (true) {
@@ -267,10 +4137,32 @@ int main() {
              << "5. Process Settlement\n"
              << "6. View Debt Graph\n"
              << "7. Exit\n"
+             << "8. Simplify Debts\n"
+             << "9. Audit Balances\n"
+             << "10. Settlement Throughput\n"
+             << "11. Process All Settlements\n"
+             << "12. Top Creditors and Debtors\n"
+             << "13. Set Report Format\n"
+             << "14. Switch Group\n"
+             << "15. Expense History\n"
+             << "16. Balances As Of\n"
+             << "17. User Expenses\n"
+             << "18. Expenses Paid By User\n"
+             << "19. Operation Stats\n"
+             << "20. Cancel Debt Cycles\n"
+             << "21. Add Itemized Expense\n"
              << "Enter your choice: ";
         cin >> choice;
         cin.ignore();
 
+        // Only the options that neither prompt nor take a view lock the
+        // ledger here. The others read their input first and lock it only to
+        // apply it, so someone typing never holds up the background worker
+        // (and submitting a settlement never waits on a full ring while
+        // holding the lock the worker needs to drain it).
+        unique_lock<mutex> lock(ledger->lock, defer_lock);
+        if (choice == 5 || choice == 8 || choice == 9 || choice == 11 || choice == 20) lock.lock();
+
         switch (choice) {
             case 1: addExpense(); break;
             case 2: printExpenses(); break;
@@ -278,8 +4170,35 @@ int main() {
             case 4: printBalances(); break;
             case 5: processSettlement(); break;
             case 6: printGraph(); break;
-            case 7: cout << "Exiting...\n"; return 0;
+            case 7:
+                cout << "Exiting...\n";
+                if (lock.owns_lock()) lock.unlock();
+                stopSettlementWorker();
+                return writeAllSnapshots() ? 0 : 1;
+            case 8: printSimplifiedDebts(); break;
+            case 9: auditBalances(); break;
+            case 10: printSettlementThroughput(); break;
+            case 11: processAllSettlements(); break;
+            case 12: {
+                size_t count = strtoul(readString("How many of each to show? ").c_str(), nullptr, 10);
+                lock.lock();
+                printTopBalances(count > 0 ? count : 5);
+                break;
+            }
+            case 13: chooseReportFormat(); break;
+            case 14: switchGroup(); break;
+            case 15: showExpenseHistory(); break;
+            case 16: showBalancesAsOf(); break;
+            case 17: showUserExpenses(false); break;
+            case 18: showUserExpenses(true); break;
+            case 19: printOperationStats(); break;
+            case 20: printCycleStats(cancelDebtCycles()); break;
+            case 21: addItemizedExpense(); break;
             default: cout << "Invalid choice. Try again.\n"; break;
         }
+        // After a group switch this is the new group, whose lock is taken
+        if (!lock.owns_lock()) lock = unique_lock<mutex>(ledger->lock);
+        flushJournal();
     }
 }
+#endif